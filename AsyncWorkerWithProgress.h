@@ -1,45 +1,72 @@
+#pragma once
 #include "nan.h"
 
+#include <memory>
+#include <atomic>
+
 struct ProgressData {
 public:
   ProgressData();
   double m_lastValue;
   double m_percent;
   double m_progress;
+  const char* m_phase; // static name of the current phase ( NULL if none )
 };
 
 inline ProgressData::ProgressData()
 :m_lastValue(0)
 ,m_percent(0)
 ,m_progress(0)
+,m_phase(0)
 {}
 
+// shared between a worker and the javascript handle that can cancel it,
+// the handle may outlive the worker
+typedef std::shared_ptr<std::atomic<bool> > CancelFlag;
+
 class AsyncWorkerWithProgress : public Nan::AsyncWorker {
 
   Nan::Callback* _progressCallback;
-  uv_async_t async;
+  uv_async_t* async;        // freed by close_async : libuv uses it until then
+  uv_mutex_t _sentDataMutex;
+  ProgressData _sentData;  // copy of m_data made by send_notify_progress, read in the main loop
 protected:
   std::string _filename;
 public:
-  ProgressData m_data;
+  ProgressData m_data;     // only used by the working thread
+  CancelFlag m_cancelled;  // set in the main loop thread to ask the working thread to stop
 
 public:
   AsyncWorkerWithProgress(Nan::Callback *callback,Nan::Callback* progressCallback,std::string*  pfilename)
     : Nan::AsyncWorker(callback) , _progressCallback(progressCallback)
+    , m_cancelled(std::make_shared<std::atomic<bool> >(false))
   {
     _filename = *pfilename; 
     delete pfilename;
 
-    uv_async_init(uv_default_loop(),&async,AsyncWorkerWithProgress::notify_progress);
-    async.data = this;
+    uv_mutex_init(&_sentDataMutex);
+    async = new uv_async_t;
+    uv_async_init(uv_default_loop(),async,AsyncWorkerWithProgress::notify_progress);
+    async->data = this;
 
   }
+  AsyncWorkerWithProgress(Nan::Callback *callback,Nan::Callback* progressCallback)
+    : Nan::AsyncWorker(callback) , _progressCallback(progressCallback)
+    , m_cancelled(std::make_shared<std::atomic<bool> >(false))
+  {
+    uv_mutex_init(&_sentDataMutex);
+    async = new uv_async_t;
+    uv_async_init(uv_default_loop(),async,AsyncWorkerWithProgress::notify_progress);
+    async->data = this;
+  }
   ~AsyncWorkerWithProgress() {
 
     if (_progressCallback) {
       delete _progressCallback;
     }
-    uv_close((uv_handle_t*) &async, NULL);
+    async->data = NULL;
+    uv_close((uv_handle_t*) async, AsyncWorkerWithProgress::close_async);
+    uv_mutex_destroy(&_sentDataMutex);
 
   }
 
@@ -56,11 +83,20 @@ public:
   * in the thread of the main loop.
   * this is equivalent of asking uv to call notify_progress in the context of the
   * main loop in the near future.
+  * m_data is copied under a lock : the main loop never reads the values that the
+  * working thread is changing.
   */
   void send_notify_progress() {
-    uv_async_send(&this->async);
+    uv_mutex_lock(&_sentDataMutex);
+    _sentData = m_data;
+    uv_mutex_unlock(&_sentDataMutex);
+    uv_async_send(this->async);
   };
 
+  bool cancelled() const {
+    return m_cancelled->load();
+  }
+
 #if NODE_MODULE_VERSION >= 14 // 12
 static void notify_progress(uv_async_t* handle) 
 #else
@@ -68,7 +104,14 @@ static void notify_progress(uv_async_t* handle,int status/*unused*/)
 #endif
   {
     AsyncWorkerWithProgress *worker = static_cast<AsyncWorkerWithProgress*>(handle->data);
-    worker->notify_progress();
+    if (worker) {
+      worker->notify_progress();
+    }
+  }
+
+  static void close_async(uv_handle_t* handle)
+  {
+    delete (uv_async_t*) handle;
   }
 
   /**
@@ -84,11 +127,16 @@ static void notify_progress(uv_async_t* handle,int status/*unused*/)
     if (_progressCallback && !_progressCallback->IsEmpty()) {
       //xx printf("notify_progress %lf %d\n",m_data.percent,m_data.progress);
       Nan::EscapableHandleScope scope;
-      v8::Local<v8::Value> argv[2] = {
-        Nan::New<v8::Number>(this->m_data.m_progress),
-        Nan::New<v8::Integer>((int)this->m_data.m_percent)
+      uv_mutex_lock(&_sentDataMutex);
+      const ProgressData data = _sentData;
+      uv_mutex_unlock(&_sentDataMutex);
+      const char* phase = data.m_phase;
+      v8::Local<v8::Value> argv[3] = {
+        Nan::New<v8::Number>(data.m_progress),
+        Nan::New<v8::Integer>((int)data.m_percent),
+        phase ? v8::Local<v8::Value>(Nan::New(phase).ToLocalChecked()) : v8::Local<v8::Value>(Nan::Undefined())
       };
-      _progressCallback->Call(2,argv);
+      _progressCallback->Call(phase ? 3 : 2,argv);
     }
   }
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "Util.h"
 #include "Mesh.h"
+#include "EdgeExtractor.h"
 
 #include <assert.h>
 
@@ -268,22 +269,9 @@ v8::Local<v8::Object> Edge::polygonize(double factor)
 
   const TopoDS_Edge& edge = TopoDS::Edge(this->shape());
 
-  BRepAdaptor_Curve curve_adaptor(edge);
-  GCPnts_UniformDeflection discretizer;
-  discretizer.Initialize(curve_adaptor, 0.05);
-
   m_positions.clear();
-  m_positions.reserve(discretizer.NbPoints()*3);
-
-  for (int i = 0; i < discretizer.NbPoints(); i++) {
-
-    gp_Pnt pt = curve_adaptor.Value(discretizer.Parameter(i + 1));
-
-    //xx std::cerr  << "[ " << pt.X() << " " << pt.Y() << " " << pt.Z() << " ] ,";
-    m_positions.push_back(static_cast<float>(pt.X()));
-    m_positions.push_back(static_cast<float>(pt.Y()));
-    m_positions.push_back(static_cast<float>(pt.Z()));
-  } 
+  // factor is the maximum deflection of the polyline
+  discretizeEdge(edge, factor, m_positions);
 
   int length = (int)m_positions.size();
   return makeFloat32Array(m_positions.data(), length);
@@ -304,5 +292,7 @@ NAN_METHOD(Edge::polygonize)
     ReadDouble(info[0],factor);
   }
 
-  info.GetReturnValue().Set(pThis->polygonize(factor));
+  try {
+    info.GetReturnValue().Set(pThis->polygonize(factor));
+  } CATCH_AND_RETHROW("Failed to polygonize edge ");
 }
@@ -3,6 +3,7 @@
 #include "Edge.h"
 #include "Util.h"
 #include "Mesh.h"
+#include "MeshWorker.h"
 
 Face::~Face() {
 	m_cacheMesh.Reset();
@@ -164,12 +165,41 @@ NAN_PROPERTY_GETTER(Face::_mesh)
 
   Face* pThis = ObjectWrap::Unwrap<Face>(info.This());
   if (pThis->m_cacheMesh.IsEmpty()) {
-	  pThis->m_cacheMesh.Reset(pThis->createMesh(0.5, 20 * 3.14159 / 180.0, true));
+    pThis->m_cacheMesh.Reset(pThis->createMesh(MeshParameters()));
   }
   info.GetReturnValue().Set(Nan::New(pThis->m_cacheMesh));
 }
 
-v8::Handle<v8::Object> Face::createMesh(double factor, double angle, bool qualityNormals)
+//
+// faces obtained from a solid can read their triangles in the mesh of the solid
+// without copy : vertices and normals are views on the vertices of the face,
+// triangles is a view on the triangles of the face whose indices refer to the
+// whole solid mesh ( subtract vertexOffset to index the vertices of the view ).
+// undefined for a face without solid, or when the vertices of the solid mesh
+// have been welded ( use face.mesh instead ).
+//
+NAN_PROPERTY_GETTER(Face::_meshView)
+{
+  if (info.This().IsEmpty()) {
+	return info.GetReturnValue().SetUndefined();
+  }
+  if (info.This()->InternalFieldCount() == 0 ) {
+	return info.GetReturnValue().SetUndefined();
+  }
+
+  Face* pThis = ObjectWrap::Unwrap<Face>(info.This());
+  v8::Local<v8::Value> solid = info.This()->Get(Nan::New("_solid").ToLocalChecked());
+  if (solid.IsEmpty() || !solid->IsObject()) {
+	return info.GetReturnValue().SetUndefined();
+  }
+  v8::Local<v8::Value> solidMesh = solid->ToObject()->Get(Nan::New("mesh").ToLocalChecked());
+  if (solidMesh.IsEmpty() || !solidMesh->IsObject() || !IsInstanceOf<Mesh>(solidMesh->ToObject())) {
+	return info.GetReturnValue().SetUndefined();
+  }
+  info.GetReturnValue().Set(Mesh::createFaceView(solidMesh->ToObject(), pThis->face()));
+}
+
+v8::Handle<v8::Object> Face::createMesh(const MeshParameters& params)
 {
   Nan::EscapableHandleScope scope;
   const unsigned argc = 0;
@@ -183,10 +213,10 @@ v8::Handle<v8::Object> Face::createMesh(double factor, double angle, bool qualit
   try {
     // this code assume that the triangulation has been created
     // on the parent object
-    mesh->extractFaceMesh(this->face(), qualityNormals);
+    mesh->extractFaceMesh(this->face(), params.qualityNormals);
 
   } CATCH_AND_RETHROW("Failed to mesh solid ");
-  mesh->optimize();
+  mesh->optimize(params);
 
   return scope.Escape(theMesh);
   //xx return NanEscapeScope(th;eMesh);
@@ -194,6 +224,22 @@ v8::Handle<v8::Object> Face::createMesh(double factor, double angle, bool qualit
 }
 
 
+/**
+ * createMeshAsync(deflection, angle, callback [, progressCallback])
+ *  triangulates the face in a working thread, callback(err, mesh) is called
+ *  in the main loop when the mesh is ready.
+ */
+NAN_METHOD(Face::createMeshAsync)
+{
+  v8::Handle<v8::Object> pJhis = info.This();
+  if ( pJhis.IsEmpty() || !IsInstanceOf<Face>(pJhis))  {
+    return Nan::ThrowError("invalid object");
+  }
+  Face* pThis = node::ObjectWrap::Unwrap<Face>(pJhis);
+  ::createMeshAsync(pThis->shape(), info);
+}
+
+
 void Face::InitNew(_NAN_METHOD_ARGS)
 {
   Base::InitNew(info);
@@ -225,6 +271,8 @@ void Face::Init(v8::Handle<v8::Object> target)
   EXPOSE_READ_ONLY_PROPERTY_BOOLEAN(Face,isPlanar);
   EXPOSE_READ_ONLY_PROPERTY_BOOLEAN(Face,hasMesh);
   EXPOSE_READ_ONLY_PROPERTY(_mesh,mesh);
+  EXPOSE_READ_ONLY_PROPERTY(_meshView,meshView);
+  EXPOSE_METHOD(Face,createMeshAsync);
   EXPOSE_TEAROFF(Face,centreOfMass);
   target->Set(Nan::New("Face").ToLocalChecked(), tpl->GetFunction());
 }
@@ -4,6 +4,7 @@
 
 #include "Base.h"
 #include "Point3Wrap.h"
+#include "MeshExtractor.h"
 
 #include <vector>
 class Wire;
@@ -43,13 +44,15 @@ public:
   virtual void InitNew(_NAN_METHOD_ARGS);
 
 
-  v8::Handle<v8::Object> createMesh(double factor, double angle, bool qualityNormals);
+  v8::Handle<v8::Object> createMesh(const MeshParameters& params);
 
   static void Init(v8::Handle<v8::Object> target);
   static v8::Handle<v8::Object> NewInstance(const TopoDS_Face& face);
 
   static NAN_METHOD(New);
   static NAN_PROPERTY_GETTER(_mesh);
+  static NAN_PROPERTY_GETTER(_meshView);
+  static NAN_METHOD(createMeshAsync);
 
   static Nan::Persistent<v8::FunctionTemplate> _template;
 };
\ No newline at end of file
@@ -0,0 +1,451 @@
+#include "MeshWorker.h"
+
+#include "Base.h"
+#include "Util.h"
+#include "Tools.h"
+
+#include <algorithm>
+
+
+MeshAsyncWorker::MeshAsyncWorker(Nan::Callback *callback, Nan::Callback* progressCallback,
+                                 const TopoDS_Shape& shape, const MeshParameters& params)
+  : AsyncWorkerWithProgress(callback, progressCallback)
+  , m_shape(shape)
+  , m_params(params)
+  , m_mesh(new Mesh())
+  , retValue(0)
+{
+}
+
+MeshAsyncWorker::~MeshAsyncWorker()
+{
+  delete m_mesh;
+}
+
+void MeshAsyncWorker::Execute()
+{
+  retValue = 0;
+  try {
+
+    meshShape(*m_mesh, m_shape, m_params, this);
+    m_mesh->optimize(m_params);
+
+  } catch (Standard_Failure&) {
+    Handle_Standard_Failure e = Standard_Failure::Caught();
+    Standard_CString msg = e->GetMessageString();
+    message = (msg != NULL && strlen(msg) > 1) ? msg : "Failed to mesh shape";
+    retValue = 1;
+  } catch (...) {
+    message = "caught C++ exception in createMeshAsync";
+    retValue = -3;
+  }
+}
+
+void MeshAsyncWorker::onFaceExtracted(size_t nbExtractedFaces, size_t nbFaces)
+{
+  double value = double(nbExtractedFaces) / double(nbFaces);
+  if (value - m_data.m_lastValue > 0.01 || nbExtractedFaces == nbFaces) {
+    m_data.m_percent  = value * 100.0;
+    m_data.m_progress = double(nbExtractedFaces);
+    m_data.m_lastValue = value;
+    send_notify_progress();
+  }
+}
+
+void MeshAsyncWorker::HandleOKCallback()
+{
+  if (retValue == 0) {
+
+    v8::Local<v8::Object> theMesh = Nan::New(Mesh::_template)->GetFunction()->NewInstance(0, 0);
+    Mesh* mesh = Mesh::Unwrap<Mesh>(theMesh);
+
+    // hand the native buffers over to the wrapped mesh
+    mesh->swap(*m_mesh);
+
+    v8::Local<v8::Value> argv[2] = { Nan::New<v8::Integer>(0), theMesh };
+    callback->Call(2, argv);
+  } else {
+    v8::Local<v8::Value> argv[2] = {
+      Nan::New<v8::Integer>(retValue),
+      v8::Local<v8::Value>(Nan::New(message.c_str()).ToLocalChecked())
+    };
+    callback->Call(2, argv);
+  }
+}
+
+void createMeshAsync(const TopoDS_Shape& shape, const MeshParameters& params,
+                     v8::Local<v8::Function> _callback, v8::Local<v8::Function> _progressCallback)
+{
+  Nan::Callback* callback = new Nan::Callback(_callback);
+  Nan::Callback* progressCallback = _progressCallback.IsEmpty() ? NULL : new Nan::Callback(_progressCallback);
+  Nan::AsyncQueueWorker(new MeshAsyncWorker(callback, progressCallback, shape, params));
+}
+
+void createMeshAsync(const TopoDS_Shape& shape, _NAN_METHOD_ARGS)
+{
+  MeshParameters params;
+  ReadDouble(info[0], params.deflection);
+  ReadDouble(info[1], params.angle);
+
+  // options object is optional
+  int iCallback = 2;
+  if (!info[2]->IsFunction()) {
+    if (!ReadMeshParameters(info[2], params)) {
+      return;
+    }
+    iCallback = 3;
+  }
+
+  if (!info[iCallback]->IsFunction()) {
+    return Nan::ThrowError("expecting a callback function : createMeshAsync(deflection, angle, [options,] callback [, progressCallback])");
+  }
+  v8::Local<v8::Function> callback = info[iCallback].As<v8::Function>();
+  v8::Local<v8::Function> progressCallback;
+  if (info[iCallback + 1]->IsFunction()) {
+    // OPTIONAL
+    progressCallback = info[iCallback + 1].As<v8::Function>();
+  }
+
+  if (shape.IsNull()) {
+    return Nan::ThrowError("cannot mesh a null shape");
+  }
+  createMeshAsync(shape, params, callback, progressCallback);
+}
+
+
+MeshStreamCredit::MeshStreamCredit(size_t maxChunks, const CancelFlag& cancelled)
+  : m_nbChunks(0)
+  , m_maxChunks(maxChunks < 1 ? 1 : maxChunks)
+  , m_cancelled(cancelled)
+{
+  uv_mutex_init(&m_mutex);
+  uv_cond_init(&m_released);
+}
+
+MeshStreamCredit::~MeshStreamCredit()
+{
+  uv_cond_destroy(&m_released);
+  uv_mutex_destroy(&m_mutex);
+}
+
+bool MeshStreamCredit::acquire()
+{
+  // the cancel handle only sets the flag : it is polled between two waits
+  const uint64_t pollInterval = 100 * 1000 * 1000; // nanoseconds
+
+  uv_mutex_lock(&m_mutex);
+  while (m_nbChunks >= m_maxChunks && !m_cancelled->load()) {
+    uv_cond_timedwait(&m_released, &m_mutex, pollInterval);
+  }
+  const bool acquired = !m_cancelled->load();
+  if (acquired) {
+    m_nbChunks++;
+  }
+  uv_mutex_unlock(&m_mutex);
+  return acquired;
+}
+
+void MeshStreamCredit::release()
+{
+  uv_mutex_lock(&m_mutex);
+  if (m_nbChunks > 0) {
+    m_nbChunks--;
+  }
+  uv_cond_signal(&m_released);
+  uv_mutex_unlock(&m_mutex);
+}
+
+void MeshStreamCredit::cancel()
+{
+  uv_mutex_lock(&m_mutex);
+  m_cancelled->store(true);
+  uv_cond_broadcast(&m_released);
+  uv_mutex_unlock(&m_mutex);
+}
+
+//
+// the next() function given to the chunk callback : it releases its chunk once,
+// when it is called or when it is garbage collected without having been called.
+//
+struct MeshChunkRelease {
+  std::shared_ptr<MeshStreamCredit> credit;
+  bool released;
+  Nan::Persistent<v8::Function> function;
+
+  void release()
+  {
+    if (!released) {
+      released = true;
+      credit->release();
+    }
+  }
+};
+
+static NAN_METHOD(releaseChunk)
+{
+  MeshChunkRelease* chunkRelease = static_cast<MeshChunkRelease*>(info.Data().As<v8::External>()->Value());
+  chunkRelease->release();
+}
+
+static void onChunkReleaseCollected(const Nan::WeakCallbackInfo<MeshChunkRelease>& data)
+{
+  MeshChunkRelease* chunkRelease = data.GetParameter();
+  chunkRelease->release();
+  chunkRelease->function.Reset();
+  delete chunkRelease;
+}
+
+static v8::Local<v8::Function> makeReleaseFunction(const std::shared_ptr<MeshStreamCredit>& credit)
+{
+  MeshChunkRelease* chunkRelease = new MeshChunkRelease();
+  chunkRelease->credit = credit;
+  chunkRelease->released = false;
+  v8::Local<v8::Function> function =
+    Nan::New<v8::FunctionTemplate>(releaseChunk, Nan::New<v8::External>(chunkRelease))->GetFunction();
+  chunkRelease->function.Reset(function);
+  chunkRelease->function.SetWeak(chunkRelease, onChunkReleaseCollected, Nan::WeakCallbackType::kParameter);
+  return function;
+}
+
+
+MeshStreamWorker::MeshStreamWorker(Nan::Callback *callback, Nan::Callback* progressCallback, Nan::Callback* chunkCallback,
+                                   const TopoDS_Shape& shape, const MeshParameters& params,
+                                   size_t chunkTriangles, size_t maxPendingChunks, bool explicitRelease)
+  : AsyncWorkerWithProgress(callback, progressCallback)
+  , m_shape(shape)
+  , m_params(params)
+  , m_chunkTriangles(chunkTriangles)
+  , m_chunkCallback(chunkCallback)
+  , m_explicitRelease(explicitRelease)
+  , m_credit(std::make_shared<MeshStreamCredit>(maxPendingChunks, m_cancelled))
+  , m_chunkAsync(new uv_async_t)
+  , m_chunkFailed(false)
+  , m_nbChunks(0)
+  , m_nbVertices(0)
+  , m_nbTriangles(0)
+  , retValue(0)
+{
+  uv_mutex_init(&m_mutex);
+  uv_async_init(uv_default_loop(), m_chunkAsync, MeshStreamWorker::notify_chunks);
+  m_chunkAsync->data = this;
+}
+
+MeshStreamWorker::~MeshStreamWorker()
+{
+  for (size_t i = 0; i < m_pendingChunks.size(); i++) {
+    delete m_pendingChunks[i].mesh;
+  }
+  delete m_chunkCallback;
+  // the next() functions still held by javascript may outlive the worker
+  m_credit->cancel();
+  // libuv still uses the handle until the close callback is called
+  m_chunkAsync->data = NULL;
+  uv_close((uv_handle_t*) m_chunkAsync, MeshStreamWorker::close_chunks);
+  uv_mutex_destroy(&m_mutex);
+}
+
+void MeshStreamWorker::close_chunks(uv_handle_t* handle)
+{
+  delete (uv_async_t*) handle;
+}
+
+void MeshStreamWorker::Execute()
+{
+  retValue = 0;
+  try {
+
+    meshShapeInChunks(m_shape, m_params, m_chunkTriangles, this, this);
+
+    if (cancelled()) {
+      message = "the mesh stream has been cancelled";
+      retValue = 2;
+    }
+
+  } catch (Standard_Failure&) {
+    Handle_Standard_Failure e = Standard_Failure::Caught();
+    Standard_CString msg = e->GetMessageString();
+    message = (msg != NULL && strlen(msg) > 1) ? msg : "Failed to mesh shape";
+    retValue = 1;
+  } catch (...) {
+    message = "caught C++ exception in createMeshStream";
+    retValue = -3;
+  }
+}
+
+void MeshStreamWorker::onFaceExtracted(size_t nbExtractedFaces, size_t nbFaces)
+{
+  double value = double(nbExtractedFaces) / double(nbFaces);
+  if (value - m_data.m_lastValue > 0.01 || nbExtractedFaces == nbFaces) {
+    m_data.m_percent  = value * 100.0;
+    m_data.m_progress = double(nbExtractedFaces);
+    m_data.m_lastValue = value;
+    send_notify_progress();
+  }
+}
+
+void MeshStreamWorker::onChunk(const MeshChunk& chunk)
+{
+  m_nbChunks++;
+  m_nbVertices += (size_t)chunk.mesh->numVertices();
+  m_nbTriangles += (size_t)chunk.mesh->numTriangles();
+
+  // back pressure : wait until javascript has released enough chunks
+  if (!m_credit->acquire()) {
+    delete chunk.mesh;
+    Standard_Failure::Raise("the mesh stream has been cancelled");
+  }
+
+  uv_mutex_lock(&m_mutex);
+  m_pendingChunks.push_back(chunk);
+  uv_mutex_unlock(&m_mutex);
+
+  uv_async_send(m_chunkAsync);
+}
+
+#if NODE_MODULE_VERSION >= 14
+void MeshStreamWorker::notify_chunks(uv_async_t* handle)
+#else
+void MeshStreamWorker::notify_chunks(uv_async_t* handle, int status/*unused*/)
+#endif
+{
+  MeshStreamWorker* worker = static_cast<MeshStreamWorker*>(handle->data);
+  if (worker) {
+    worker->deliverChunks();
+  }
+}
+
+//
+// releases the credit of a chunk delivered to a callback without a next
+// argument, whichever way the callback returns.
+//
+struct MeshChunkScopeRelease {
+  MeshStreamCredit* credit; // NULL when javascript releases the chunk itself
+  ~MeshChunkScopeRelease()
+  {
+    if (credit) {
+      credit->release();
+    }
+  }
+};
+
+//
+// uv_async_send may coalesce several notifications : all the pending
+// chunks are delivered, one at a time so that the working thread can
+// resume as soon as a chunk is released.
+//
+void MeshStreamWorker::deliverChunks()
+{
+  for (;;) {
+    uv_mutex_lock(&m_mutex);
+    if (m_pendingChunks.empty()) {
+      uv_mutex_unlock(&m_mutex);
+      break;
+    }
+    MeshChunk chunk = m_pendingChunks.front();
+    m_pendingChunks.pop_front();
+    uv_mutex_unlock(&m_mutex);
+
+    if (m_chunkFailed) {
+      // the stream is over, the working thread has been cancelled
+      delete chunk.mesh;
+      continue;
+    }
+
+    Nan::HandleScope scope;
+    v8::Local<v8::Object> theMesh = Nan::New(Mesh::_template)->GetFunction()->NewInstance(0, 0);
+    Mesh* mesh = Mesh::Unwrap<Mesh>(theMesh);
+    mesh->swap(*chunk.mesh);
+    delete chunk.mesh;
+
+    theMesh->Set(Nan::New("chunkIndex").ToLocalChecked(), Nan::New<v8::Number>((double)chunk.index));
+    theMesh->Set(Nan::New("vertexOffset").ToLocalChecked(), Nan::New<v8::Number>((double)chunk.firstVertex));
+    theMesh->Set(Nan::New("triangleOffset").ToLocalChecked(), Nan::New<v8::Number>((double)chunk.firstTriangle));
+
+    MeshChunkScopeRelease scopeRelease = { m_explicitRelease ? NULL : m_credit.get() };
+    v8::Local<v8::Value> result;
+    if (m_explicitRelease) {
+      v8::Local<v8::Value> argv[2] = { theMesh, makeReleaseFunction(m_credit) };
+      result = m_chunkCallback->Call(2, argv);
+    } else {
+      v8::Local<v8::Value> argv[1] = { theMesh };
+      result = m_chunkCallback->Call(1, argv);
+    }
+    if (result.IsEmpty()) {
+      // the callback has thrown : stop the working thread, even if it waits for a next() call
+      m_chunkFailed = true;
+      m_credit->cancel();
+    }
+  }
+}
+
+void MeshStreamWorker::HandleOKCallback()
+{
+  // the last chunks may not have been delivered yet
+  deliverChunks();
+
+  if (m_chunkFailed) {
+    retValue = 3;
+    message = "a chunk callback has thrown an exception, the mesh stream has been stopped";
+  }
+  if (retValue == 0) {
+    v8::Local<v8::Object> summary = Nan::New<v8::Object>();
+    summary->Set(Nan::New("numChunks").ToLocalChecked(), Nan::New<v8::Number>((double)m_nbChunks));
+    summary->Set(Nan::New("numVertices").ToLocalChecked(), Nan::New<v8::Number>((double)m_nbVertices));
+    summary->Set(Nan::New("numTriangles").ToLocalChecked(), Nan::New<v8::Number>((double)m_nbTriangles));
+
+    v8::Local<v8::Value> argv[2] = { Nan::New<v8::Integer>(0), summary };
+    callback->Call(2, argv);
+  } else {
+    v8::Local<v8::Value> argv[2] = {
+      Nan::New<v8::Integer>(retValue),
+      v8::Local<v8::Value>(Nan::New(message.c_str()).ToLocalChecked())
+    };
+    callback->Call(2, argv);
+  }
+}
+
+void createMeshStream(const TopoDS_Shape& shape, _NAN_METHOD_ARGS)
+{
+  MeshParameters params;
+  ReadDouble(info[0], params.deflection);
+  ReadDouble(info[1], params.angle);
+
+  size_t chunkTriangles = 65536;
+  size_t maxPendingChunks = 4;
+
+  // options object is optional
+  int iCallback = 2;
+  if (!info[2]->IsFunction()) {
+    if (!ReadMeshParameters(info[2], params)) {
+      return;
+    }
+    if (info[2]->IsObject()) {
+      v8::Local<v8::Object> options = info[2]->ToObject();
+      chunkTriangles   = (size_t)std::max(1, ReadInt(options, "chunkTriangles", (int)chunkTriangles));
+      maxPendingChunks = (size_t)std::max(1, ReadInt(options, "maxPendingChunks", (int)maxPendingChunks));
+    }
+    iCallback = 3;
+  }
+
+  if (!info[iCallback]->IsFunction() || !info[iCallback + 1]->IsFunction()) {
+    return Nan::ThrowError("expecting callback functions : createMeshStream(deflection, angle, [options,] chunkCallback, callback [, progressCallback])");
+  }
+  if (shape.IsNull()) {
+    return Nan::ThrowError("cannot mesh a null shape");
+  }
+  // a chunk callback declared as function(chunk, next) releases its chunks itself
+  v8::Local<v8::Function> chunkFunction = info[iCallback].As<v8::Function>();
+  const bool explicitRelease = chunkFunction->Get(Nan::New("length").ToLocalChecked())->Int32Value() >= 2;
+  Nan::Callback* chunkCallback = new Nan::Callback(chunkFunction);
+  Nan::Callback* callback = new Nan::Callback(info[iCallback + 1].As<v8::Function>());
+  Nan::Callback* progressCallback = NULL;
+  if (info[iCallback + 2]->IsFunction()) {
+    // OPTIONAL
+    progressCallback = new Nan::Callback(info[iCallback + 2].As<v8::Function>());
+  }
+  MeshStreamWorker* worker = new MeshStreamWorker(callback, progressCallback, chunkCallback,
+                                                  shape, params, chunkTriangles, maxPendingChunks, explicitRelease);
+  CancelFlag cancelFlag = worker->m_cancelled;
+  Nan::AsyncQueueWorker(worker);
+  info.GetReturnValue().Set(newCancelHandle(cancelFlag));
+}
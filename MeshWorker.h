@@ -0,0 +1,127 @@
+#pragma once
+#include "NodeV8.h"
+#include "OCC.h"
+#include "Mesh.h"
+#include "MeshExtractor.h"
+#include "AsyncWorkerWithProgress.h"
+
+#include <deque>
+
+//
+// triangulates a shape and extracts the mesh of its faces in a working thread.
+// a copy of the shape is made on the main thread and triangulated by the worker
+// ( see MeshShapeCopy ), the final Mesh wrapper and its typed arrays are created
+// in the main loop thread.
+//
+class MeshAsyncWorker : public AsyncWorkerWithProgress, public MeshProgressListener {
+public:
+  MeshAsyncWorker(Nan::Callback *callback, Nan::Callback* progressCallback,
+                  const TopoDS_Shape& shape, const MeshParameters& params);
+  ~MeshAsyncWorker();
+
+  void Execute();
+  void HandleOKCallback();
+
+  virtual void onFaceExtracted(size_t nbExtractedFaces, size_t nbFaces);
+
+protected:
+  MeshShapeCopy  m_shape;
+  MeshParameters m_params;
+
+  Mesh* m_mesh; // native mesh, not wrapped until HandleOKCallback
+  int retValue;
+  std::string message;
+};
+
+void createMeshAsync(const TopoDS_Shape& shape, const MeshParameters& params,
+                     v8::Local<v8::Function> callback, v8::Local<v8::Function> progressCallback);
+
+// shared implementation of Solid.createMeshAsync and Face.createMeshAsync
+// arguments : deflection, angle, [options,] callback [, progressCallback]
+void createMeshAsync(const TopoDS_Shape& shape, _NAN_METHOD_ARGS);
+
+
+//
+// the number of chunks of a MeshStreamWorker that javascript has not released yet.
+// it is shared with the next() functions handed to the chunk callback, which
+// may be called after the worker is gone.
+// the wait ends when the stream is cancelled ( by the cancel handle of the
+// stream, or when a chunk callback throws ), so that a chunk that javascript
+// never releases doesn't block a thread of the pool forever.
+//
+class MeshStreamCredit {
+public:
+  MeshStreamCredit(size_t maxChunks, const CancelFlag& cancelled);
+  ~MeshStreamCredit();
+
+  // called in the working thread, waits until there are less than maxChunks chunks,
+  // returns false when the stream has been cancelled
+  bool acquire();
+  // called in the main loop thread
+  void release();
+  void cancel();
+
+private:
+  uv_mutex_t m_mutex;
+  uv_cond_t  m_released;
+  size_t m_nbChunks;
+  size_t m_maxChunks;
+  CancelFlag m_cancelled;
+};
+
+//
+// meshes a shape in a working thread and hands its chunks to a javascript
+// callback as soon as they are ready ( see meshShapeInChunks ).
+// the working thread waits when maxPendingChunks chunks have not been released
+// by javascript, so that the memory in use stays bounded : a chunk is released
+// by calling the next() function given with it, or when the chunk callback
+// returns if it doesn't take a next argument.
+// a chunk callback that throws ends the stream : the chunks that follow are
+// dropped and the callback receives an error.
+//
+class MeshStreamWorker : public AsyncWorkerWithProgress, public MeshProgressListener, public MeshChunkListener {
+public:
+  MeshStreamWorker(Nan::Callback *callback, Nan::Callback* progressCallback, Nan::Callback* chunkCallback,
+                   const TopoDS_Shape& shape, const MeshParameters& params,
+                   size_t chunkTriangles, size_t maxPendingChunks, bool explicitRelease);
+  ~MeshStreamWorker();
+
+  void Execute();
+  void HandleOKCallback();
+
+  virtual void onFaceExtracted(size_t nbExtractedFaces, size_t nbFaces);
+  virtual void onChunk(const MeshChunk& chunk);
+
+protected:
+  MeshShapeCopy  m_shape;
+  MeshParameters m_params;
+  size_t m_chunkTriangles;
+
+  Nan::Callback* m_chunkCallback;
+  bool m_explicitRelease;                 // the chunk callback releases the chunks with next()
+  std::shared_ptr<MeshStreamCredit> m_credit;
+  std::deque<MeshChunk> m_pendingChunks; // extracted, not yet delivered
+  uv_mutex_t m_mutex;
+  uv_async_t* m_chunkAsync;              // freed by the uv_close callback
+  bool m_chunkFailed;                     // a chunk callback has thrown ( main loop thread only )
+
+  size_t m_nbChunks;
+  size_t m_nbVertices;
+  size_t m_nbTriangles;
+
+  int retValue;
+  std::string message;
+
+  // called in the main loop thread
+  void deliverChunks();
+#if NODE_MODULE_VERSION >= 14
+  static void notify_chunks(uv_async_t* handle);
+#else
+  static void notify_chunks(uv_async_t* handle, int status/*unused*/);
+#endif
+  static void close_chunks(uv_handle_t* handle);
+};
+
+// implementation of Solid.createMeshStream, returns a cancel handle
+// arguments : deflection, angle, [options,] chunkCallback, callback [, progressCallback]
+void createMeshStream(const TopoDS_Shape& shape, _NAN_METHOD_ARGS);
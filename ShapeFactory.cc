@@ -869,6 +869,9 @@ static void ShapeFactory_createBoolean(_NAN_METHOD_ARGS,Solid* pSolid1, Solid* p
 
     registerShapes(pTool.get(),pResult,pSolid1,pSolid2);
 
+    pResult->inheritMesh(pSolid1);
+    pResult->inheritMesh(pSolid2);
+
     if (pTool->HasDeleted())  {
       // the boolean operation causes some shape from s1 or s2 to be deleted
     }
@@ -1272,6 +1275,8 @@ static int fillet(Solid* pNewSolid,Solid* pSolid,const std::vector<Edge*>& edges
     //xx }
     registerShapes(&tool,pNewSolid,pSolid);
 
+    pNewSolid->inheritMesh(pSolid);
+
   }
   CATCH_AND_RETHROW("Failed to fillet solid ");
 
@@ -4,6 +4,8 @@
 #include "Face.h"
 #include "Edge.h"
 #include "BoundingBox.h"
+#include "MeshWorker.h"
+#include "EdgeExtractor.h"
 
 
 Nan::Persistent<v8::FunctionTemplate> Solid::_template;
@@ -34,6 +36,12 @@ void Solid::Init(v8::Handle<v8::Object> target)
   EXPOSE_METHOD(Solid,getShapeName);
   EXPOSE_METHOD(Solid,getAdjacentFaces);
   EXPOSE_METHOD(Solid,getCommonEdges);	
+  EXPOSE_METHOD(Solid,createMesh);
+  EXPOSE_METHOD(Solid,createMeshAsync);
+  EXPOSE_METHOD(Solid,createMeshStream);
+  EXPOSE_METHOD(Solid,createMeshLODs);
+  EXPOSE_METHOD(Solid,createInstancedMesh);
+  EXPOSE_METHOD(Solid,polygonizeEdges);
 
   EXPOSE_READ_ONLY_PROPERTY_DOUBLE (Solid,area);
   EXPOSE_READ_ONLY_PROPERTY_DOUBLE (Solid,volume);
@@ -197,6 +205,13 @@ NAN_METHOD(Solid::getOuterShell)
 
 }
 
+// a face that belongs to a solid can read its triangles in the solid mesh
+// ( see Face::_meshView )
+static void setParentSolid(v8::Local<v8::Object> face, v8::Local<v8::Object> solid)
+{
+  face->ForceSet(Nan::New("_solid").ToLocalChecked(), solid, v8::DontEnum);
+}
+
 NAN_METHOD(Solid::getFaces)
 {
   // can work with this
@@ -215,6 +230,7 @@ NAN_METHOD(Solid::getFaces)
 
   for (int i=0; i<nbSubShapes; i++)  {
     v8::Local<v8::Object> obj=  buildWrapper(shapeMap(i+1)); // 1 based !!!
+    setParentSolid(obj, pJhis);
     arr->Set(i,obj);
   }
   info.GetReturnValue().Set(arr);
@@ -486,11 +502,49 @@ NAN_PROPERTY_GETTER(Solid::_mesh)
   }
   Solid* pThis = ObjectWrap::Unwrap<Solid>(info.This());
   if (pThis->m_cacheMesh.IsEmpty()) {
-      pThis->m_cacheMesh.Reset(pThis->createMesh(0.5,20*3.14159/180.0,true));
+
+    // the meshes of the operands of the operation that created this solid
+    std::vector<Mesh*> sources;
+    v8::Local<v8::String> key = Nan::New("_meshSources").ToLocalChecked();
+    v8::Local<v8::Value> value = info.This()->Get(key);
+    if (!value.IsEmpty() && value->IsArray()) {
+      v8::Local<v8::Array> arr = value.As<v8::Array>();
+      for (uint32_t i = 0; i < arr->Length(); i++) {
+        v8::Local<v8::Object> obj = arr->Get(i)->ToObject();
+        if (IsInstanceOf<Mesh>(obj)) {
+          sources.push_back(node::ObjectWrap::Unwrap<Mesh>(obj));
+        }
+      }
+    }
+
+    pThis->m_cacheMesh.Reset(pThis->createMesh(MeshParameters(), sources));
+
+    if (!value.IsEmpty() && value->IsArray()) {
+      info.This()->Delete(key);
+    }
   }
   info.GetReturnValue().Set(Nan::New(pThis->m_cacheMesh));
 }
 
+void Solid::inheritMesh(Solid* operand)
+{
+  if (operand->m_cacheMesh.IsEmpty()) {
+    return;
+  }
+  v8::Local<v8::Object> pJhis = NanObjectWrapHandle(this);
+  v8::Local<v8::String> key = Nan::New("_meshSources").ToLocalChecked();
+
+  v8::Local<v8::Value> value = pJhis->Get(key);
+  v8::Local<v8::Array> arr;
+  if (!value.IsEmpty() && value->IsArray()) {
+    arr = value.As<v8::Array>();
+  } else {
+    arr = Nan::New<v8::Array>(0);
+    pJhis->ForceSet(key, arr, v8::DontEnum);
+  }
+  arr->Set(arr->Length(), Nan::New(operand->m_cacheMesh));
+}
+
 
 //void Solid::Mesh()
 //{
@@ -504,7 +558,7 @@ NAN_PROPERTY_GETTER(Solid::_mesh)
 //        BRepMesh().Mesh(shape_, 1.0);
 //    }
 //}
-v8::Handle<v8::Object>  Solid::createMesh(double factor, double angle, bool qualityNormals)
+v8::Handle<v8::Object>  Solid::createMesh(const MeshParameters& params, const std::vector<Mesh*>& sources)
 {
   Nan::EscapableHandleScope scope;
 
@@ -517,48 +571,246 @@ v8::Handle<v8::Object>  Solid::createMesh(double factor, double angle, bool qual
   const TopoDS_Shape& shape = this->shape();
 
   try {
-    BRepMesh_IncrementalMesh MSH(shape,factor,Standard_True,angle,Standard_True);
-
-    /*
-       Bnd_Box aBox;
-       BRepBndLib::Add(shape, aBox);
-
-       Standard_Real aXmin, aYmin, aZmin;
-       Standard_Real aXmax, aYmax, aZmax;
-       aBox.Get(aXmin, aYmin, aZmin, aXmax, aYmax, aZmax);
-
-       Standard_Real maxd = fabs(aXmax - aXmin);
-       maxd = std::max(maxd, fabs(aYmax - aYmin));
-       maxd = std::max(maxd, fabs(aZmax - aZmin));
-
-       BRepMesh_FastDiscret MSH(factor*maxd, angle, aBox, Standard_True, Standard_True,Standard_True, Standard_True);
-       MSH.Perform(shape);
-       */
-
-    if (shape.ShapeType() == TopAbs_COMPSOLID || shape.ShapeType() == TopAbs_COMPOUND) {
-      TopExp_Explorer exSolid, exFace;
-      for (exSolid.Init(shape, TopAbs_SOLID); exSolid.More(); exSolid.Next()) {
-        const TopoDS_Solid& solid = TopoDS::Solid(exSolid.Current());
-        for (exFace.Init(solid, TopAbs_FACE); exFace.More(); exFace.Next()) {
-          const TopoDS_Face& face = TopoDS::Face(exFace.Current());
-          if (face.IsNull()) continue;
-          mesh->extractFaceMesh(face, qualityNormals);
-        }
-      }
-    }  else {
-      TopExp_Explorer exFace;
-      for (exFace.Init(shape, TopAbs_FACE); exFace.More(); exFace.Next()) {
-        const TopoDS_Face& face = TopoDS::Face(exFace.Current());
-        if (face.IsNull()) continue;
-        mesh->extractFaceMesh(face, qualityNormals);
-      }
+
+    if (sources.empty()) {
+      meshShape(*mesh, shape, params);
+    } else {
+      meshShapeIncremental(*mesh, shape, params, sources);
     }
+
   } CATCH_AND_RETHROW("Failed to mesh solid ");
-  mesh->optimize();
+  mesh->optimize(params);
 
   return scope.Escape(theMesh);
 }
 
+/**
+ * createMesh(deflection, angle [, options])
+ *  options : { deflectionMode: "edge" | "absolute" | "relative" | "screen",
+ *              pixelError: 1, cameraDistance: 0, fieldOfView: 45 degrees in radians, viewportHeight: 1080,
+ *              qualityNormals: true, parallel: false,
+ *              weld: false, weldTolerance: 1E-6, creaseAngle: 30 degrees in radians,
+ *              vertexCache: false, overdraw: false,
+ *              encoding: "float32" | "quantized",
+ *              decimate: { targetTriangles: 0, ratio: 0, maxError: 0 } }
+ *  with encoding "quantized", mesh.encoded is an ArrayBuffer with 16 bit positions,
+ *  octahedral normals and Uint16 indices when possible, mesh.encoding gives the
+ *  decoding parameters.
+ *  deflectionMode "edge" ( the default ) makes deflection relative to the size of each edge,
+ *  "absolute" uses model units, "relative" a fraction of the bounding box diagonal and
+ *  "screen" derives the deflection from pixelError seen from cameraDistance, which must then
+ *  be positive. "relative" and "screen" never go below a ten thousandth of the diagonal.
+ *  mesh.faceranges gives, for each face, its hash code followed by the first
+ *  triangle, the number of triangles, the first vertex and the number of vertices.
+ *  decimate simplifies the triangles of each face down to targetTriangles ( or ratio times
+ *  the initial count ) without moving the surface by more than maxError; the outlines of
+ *  the faces are kept, mesh.numDecimatedTriangles counts the removed triangles.
+ */
+NAN_METHOD(Solid::createMesh)
+{
+  v8::Handle<v8::Object> pJhis = info.This();
+  if ( pJhis.IsEmpty() || !IsInstanceOf<Solid>(pJhis))  {
+    return Nan::ThrowError("invalid object");
+  }
+  Solid* pThis = node::ObjectWrap::Unwrap<Solid>(pJhis);
+
+  MeshParameters params;
+  ReadDouble(info[0], params.deflection);
+  ReadDouble(info[1], params.angle);
+  if (!ReadMeshParameters(info[2], params)) {
+    return;
+  }
+
+  info.GetReturnValue().Set(pThis->createMesh(params));
+}
+
+/**
+ * createMeshLODs([deflection1, deflection2, ...], angle [, options])
+ *  returns one mesh per level of detail, in the order of the deflections.
+ *  the deflections must be positive numbers sorted from the finest to the coarsest.
+ *  ( see createMesh for the options )
+ */
+NAN_METHOD(Solid::createMeshLODs)
+{
+  v8::Handle<v8::Object> pJhis = info.This();
+  if ( pJhis.IsEmpty() || !IsInstanceOf<Solid>(pJhis))  {
+    return Nan::ThrowError("invalid object");
+  }
+  Solid* pThis = node::ObjectWrap::Unwrap<Solid>(pJhis);
+
+  if (info.Length() < 1 || !info[0]->IsArray()) {
+    return Nan::ThrowError("expecting an array of deflections");
+  }
+  v8::Local<v8::Array> arr = info[0].As<v8::Array>();
+  if (arr->Length() == 0) {
+    return Nan::ThrowError("expecting at least one deflection");
+  }
+  std::vector<double> deflections(arr->Length());
+  for (uint32_t i = 0; i < arr->Length(); i++) {
+    v8::Local<v8::Value> value = arr->Get(i);
+    if (!value->IsNumber() || !(value->NumberValue() > 0)) {
+      return Nan::ThrowError("expecting positive deflections");
+    }
+    deflections[i] = value->NumberValue();
+    if (i > 0 && deflections[i] <= deflections[i - 1]) {
+      return Nan::ThrowError("expecting deflections sorted from the finest to the coarsest");
+    }
+  }
+
+  MeshParameters params;
+  ReadDouble(info[1], params.angle);
+  if (!ReadMeshParameters(info[2], params)) {
+    return;
+  }
+
+  v8::Local<v8::Array> result = Nan::New<v8::Array>((int)deflections.size());
+  std::vector<Mesh*> meshes(deflections.size());
+  for (uint32_t i = 0; i < deflections.size(); i++) {
+    v8::Local<v8::Object> theMesh = Nan::New(Mesh::_template)->GetFunction()->NewInstance(0, 0);
+    meshes[i] = Mesh::Unwrap<Mesh>(theMesh);
+    result->Set(i, theMesh);
+  }
+
+  try {
+    meshShapeLODs(meshes, pThis->shape(), deflections, params);
+
+    for (size_t i = 0; i < meshes.size(); i++) {
+      meshes[i]->optimize(params);
+    }
+    info.GetReturnValue().Set(result);
+  } CATCH_AND_RETHROW("Failed to mesh solid ");
+}
+
+/**
+ * createInstancedMesh(deflection, angle [, options])
+ *  meshes each distinct solid of a compound once, in its own coordinate system.
+ *  returns { meshes: [mesh, ...], instances: Int32Array, matrices: Float64Array }
+ *  where instances[i] is the index in meshes of the i-th occurrence and
+ *  matrices.subarray(16 * i, 16 * i + 16) its 4x4 column major transformation.
+ *  ( see createMesh for the options )
+ */
+NAN_METHOD(Solid::createInstancedMesh)
+{
+  v8::Handle<v8::Object> pJhis = info.This();
+  if ( pJhis.IsEmpty() || !IsInstanceOf<Solid>(pJhis))  {
+    return Nan::ThrowError("invalid object");
+  }
+  Solid* pThis = node::ObjectWrap::Unwrap<Solid>(pJhis);
+
+  MeshParameters params;
+  ReadDouble(info[0], params.deflection);
+  ReadDouble(info[1], params.angle);
+  if (!ReadMeshParameters(info[2], params)) {
+    return;
+  }
+
+  MeshInstances instances;
+  collectInstances(pThis->shape(), instances);
+
+  v8::Local<v8::Array> meshes = Nan::New<v8::Array>((int)instances.prototypes.size());
+  try {
+    // relative deflections are resolved once for the whole shape
+    const MeshParameters resolved = resolveDeflection(pThis->shape(), params);
+
+    for (size_t p = 0; p < instances.prototypes.size(); p++) {
+      v8::Local<v8::Object> theMesh = Nan::New(Mesh::_template)->GetFunction()->NewInstance(0, 0);
+      Mesh* mesh = Mesh::Unwrap<Mesh>(theMesh);
+      meshShape(*mesh, instances.prototypes[p], resolved);
+      mesh->optimize(resolved);
+      meshes->Set((uint32_t)p, theMesh);
+    }
+
+    v8::Local<v8::Object> result = Nan::New<v8::Object>();
+    result->Set(Nan::New("meshes").ToLocalChecked(), meshes);
+    result->Set(Nan::New("instances").ToLocalChecked(),
+                makeInt32Array(instances.prototypeIndex.data(), (int)instances.prototypeIndex.size()));
+    result->Set(Nan::New("matrices").ToLocalChecked(),
+                makeFloat64Array(instances.matrices.data(), (int)instances.matrices.size()));
+    info.GetReturnValue().Set(result);
+  } CATCH_AND_RETHROW("Failed to mesh solid ");
+}
+
+/**
+ * createMeshAsync(deflection, angle, callback [, progressCallback])
+ *  triangulates the solid in a working thread, callback(err, mesh) is called
+ *  in the main loop when the mesh is ready.
+ *  the worker triangulates a copy of the solid : the solid itself can be used
+ *  in the meantime, but it doesn't receive the triangulation.
+ */
+NAN_METHOD(Solid::createMeshAsync)
+{
+  v8::Handle<v8::Object> pJhis = info.This();
+  if ( pJhis.IsEmpty() || !IsInstanceOf<Solid>(pJhis))  {
+    return Nan::ThrowError("invalid object");
+  }
+  Solid* pThis = node::ObjectWrap::Unwrap<Solid>(pJhis);
+  ::createMeshAsync(pThis->shape(), info);
+}
+
+/**
+ * createMeshStream(deflection, angle, [options,] chunkCallback, callback [, progressCallback])
+ *  triangulates the solid in a working thread and calls chunkCallback(chunk [, next]) in
+ *  the main loop for each chunk of whole faces holding at least options.chunkTriangles
+ *  triangles ( 65536 by default ). Faces are not split, so a chunk holds more triangles
+ *  when a face is large, and the last chunk may hold fewer.
+ *  A chunk is a Mesh with chunkIndex, vertexOffset and
+ *  triangleOffset : its triangles index its own vertices, add vertexOffset to get the
+ *  index in the mesh of the whole solid. The working thread waits when
+ *  options.maxPendingChunks ( 4 by default ) chunks have not been released yet.
+ *  When chunkCallback declares the next argument, a chunk is released when next() is
+ *  called ( for instance once the chunk has been written to a stream ), otherwise it is
+ *  released as soon as chunkCallback returns.
+ *  callback(err, { numChunks, numVertices, numTriangles }) is called after the last chunk.
+ *  Returns a handle : handle.cancel() stops the stream, the working thread doesn't wait
+ *  for the chunks that have not been released anymore and the callback gets an error.
+ *  A stream whose next() functions are kept but never called must be cancelled.
+ *  When chunkCallback throws, the stream is stopped and the callback gets an error.
+ *  ( see createMesh for the other options, they are applied to each chunk )
+ */
+NAN_METHOD(Solid::createMeshStream)
+{
+  v8::Handle<v8::Object> pJhis = info.This();
+  if ( pJhis.IsEmpty() || !IsInstanceOf<Solid>(pJhis))  {
+    return Nan::ThrowError("invalid object");
+  }
+  Solid* pThis = node::ObjectWrap::Unwrap<Solid>(pJhis);
+  ::createMeshStream(pThis->shape(), info);
+}
+
+/**
+ * polygonizeEdges([deflection])
+ *  returns the polylines of all the edges of the solid in one call :
+ *  { positions: Float32Array, offsets: Uint32Array, hashes: Int32Array }
+ *  the points of edge i are the points offsets[i] to offsets[i+1]-1 of positions.
+ */
+NAN_METHOD(Solid::polygonizeEdges)
+{
+  v8::Handle<v8::Object> pJhis = info.This();
+  if ( pJhis.IsEmpty() || !IsInstanceOf<Solid>(pJhis))  {
+    return Nan::ThrowError("invalid object");
+  }
+  Solid* pThis = node::ObjectWrap::Unwrap<Solid>(pJhis);
+
+  double deflection = MeshParameters().deflection;
+  if (info.Length()>=1) {
+    ReadDouble(info[0], deflection);
+  }
+
+  EdgePolylines polylines;
+  try {
+    extractEdgePolylines(pThis->shape(), deflection, polylines);
+  } CATCH_AND_RETHROW("Failed to polygonize edges ");
+
+  v8::Local<v8::Object> result = Nan::New<v8::Object>();
+  result->Set(Nan::New("positions").ToLocalChecked(),
+              makeFloat32Array(polylines.positions.data(), (int)polylines.positions.size()));
+  result->Set(Nan::New("offsets").ToLocalChecked(),
+              makeUint32Array(polylines.offsets.data(), (int)polylines.offsets.size()));
+  result->Set(Nan::New("hashes").ToLocalChecked(),
+              makeInt32Array(polylines.hashes.data(), (int)polylines.hashes.size()));
+  info.GetReturnValue().Set(result);
+}
+
 
 NAN_METHOD(Solid::getShapeName)
 {
@@ -594,7 +846,9 @@ void Solid::_registerNamedShape(const char* name,const TopoDS_Shape& shape)
 {
   if (shape.ShapeType() == TopAbs_FACE)  {
     v8::Local<v8::Object> obj = NanObjectWrapHandle(this)->Get(Nan::New("faces").ToLocalChecked())->ToObject();
-    obj->Set(Nan::New(name).ToLocalChecked(),    Face::NewInstance(TopoDS::Face(shape)));
+    v8::Local<v8::Object> face = Face::NewInstance(TopoDS::Face(shape));
+    setParentSolid(face, NanObjectWrapHandle(this));
+    obj->Set(Nan::New(name).ToLocalChecked(), face);
   }
 
   v8::Local<v8::Object> reversedMap = NanObjectWrapHandle(this)->Get(Nan::New("_reversedMap").ToLocalChecked())->ToObject();
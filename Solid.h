@@ -1,6 +1,7 @@
 #pragma once
 #include "Shape.h"
 #include "Mesh.h"
+#include "MeshExtractor.h"
 
 class Edge;
 // a multi body shape
@@ -31,7 +32,12 @@ public:
 
   virtual void InitNew(_NAN_METHOD_ARGS);
 
-  v8::Handle<v8::Object> createMesh(double factor, double angle, bool qualityNormals = true);
+  v8::Handle<v8::Object> createMesh(const MeshParameters& params,
+                                    const std::vector<Mesh*>& sources = std::vector<Mesh*>());
+
+  // the default mesh of this solid will reuse the faces of the default
+  // mesh of the operand that are left unchanged by the operation
+  void inheritMesh(Solid* operand);
 
   typedef enum BoolOpType {
     BOOL_FUSE,
@@ -50,6 +56,11 @@ public:
   static NAN_PROPERTY_GETTER(_mesh);
 
   static NAN_METHOD(createMesh); // custom mesh
+  static NAN_METHOD(createMeshAsync); // custom mesh computed in a working thread
+  static NAN_METHOD(createMeshStream); // mesh delivered in chunks from a working thread
+  static NAN_METHOD(createMeshLODs); // one mesh per level of detail
+  static NAN_METHOD(createInstancedMesh); // one mesh per distinct solid and a table of instances
+  static NAN_METHOD(polygonizeEdges); // all the edge polylines in one buffer
 
   static NAN_METHOD(getEdges);
   static NAN_METHOD(getVertices);
@@ -7,7 +7,15 @@
 
 #include <list>
 #include <strstream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
 #include "AsyncWorkerWithProgress.h"
+#include "GLBWriter.h"
+#include "STLWriter.h"
+#include "Util.h"
 
 //
 // ref : http://nikhilm.github.io/uvbook/threads.html
@@ -50,24 +58,268 @@ static bool extractCallback(const v8::Handle<v8::Value>& value, v8::Handle<v8::F
   assert(!callback.IsEmpty());
   return true;
 }
+// a file name, or a Buffer holding the content of the file
+static bool extractSource(const v8::Handle<v8::Value>& value, std::string& filename, v8::Local<v8::Object>& buffer)
+{
+  if (node::Buffer::HasInstance(value)) {
+    buffer = value->ToObject();
+    return true;
+  }
+  return extractFileName(value, filename);
+}
 
+// a stream buffer that reads a block of memory ( the memory is not copied )
+class MemoryReadStreamBuf : public std::streambuf {
+public:
+  MemoryReadStreamBuf(const char* data, size_t length) {
+    char* p = const_cast<char*>(data);
+    setg(p, p, p + length);
+  }
+};
 
-NAN_METHOD(writeSTEP)
+//
+// writes the model transferred by the writer to a stream : STEPControl_Writer
+// only writes files, this is what its work library does with the file stream.
+//
+static bool writeStepStream(STEPControl_Writer& writer, std::ostream& out)
 {
-  std::string filename;
-  if (!extractFileName(info[0], filename)) {
-    return Nan::ThrowError("expecting a file name");
+  occHandle(StepData_StepModel) model = writer.Model();
+  occHandle(StepData_Protocol) protocol = occHandle(StepData_Protocol)::DownCast(writer.WS()->Protocol());
+  if (model.IsNull() || protocol.IsNull()) {
+    return false;
   }
+  StepData_StepWriter stepWriter(model);
+  stepWriter.SendModel(protocol);
+  return stepWriter.Print(out) && !out.fail();
+}
 
-  std::list<Shape*>  shapes;
+static v8::Local<v8::Object> copyToBuffer(const std::string& data)
+{
+  return Nan::CopyBuffer(data.data(), (uint32_t)data.size()).ToLocalChecked();
+}
+
+
+//
+// arguments of the writers : filename, shapes..., [options,] [callback [, progressCallback]]
+// options is the last plain object found among the shapes.
+//
+static void extractWriterArguments(_NAN_METHOD_ARGS, std::list<Shape*>& shapes, v8::Local<v8::Object>& options,
+                                   v8::Local<v8::Function>& callback, v8::Local<v8::Function>& progressCallback)
+{
   for (int i = 1; i < info.Length(); i++) {
+    if (info[i]->IsFunction()) {
+      extractCallback(info[i], callback);
+      // OPTIONAL
+      extractCallback(info[i + 1], progressCallback);
+      break;
+    }
+    if (info[i]->IsObject() && !info[i]->IsArray() && !IsInstanceOf<Solid>(info[i]->ToObject())) {
+      options = info[i]->ToObject();
+      continue;
+    }
     extractShapes(info[i], shapes);
   }
+}
+
+//
+// base of the workers that write shapes to a file : the shapes are captured
+// by value on the main thread, callback(err, true) is called when done.
+//
+class ShapeWriteWorker : public AsyncWorkerWithProgress {
+public:
+  ShapeWriteWorker(Nan::Callback *callback, Nan::Callback* progressCallback, std::string* pfilename,
+                   const std::list<Shape*>& shapes)
+    : AsyncWorkerWithProgress(callback, progressCallback, pfilename)
+    , retValue(0)
+  {
+    for (std::list<Shape*>::const_iterator it = shapes.begin(); it != shapes.end(); it++) {
+      m_shapes.push_back((*it)->shape());
+    }
+  }
+
+  void HandleOKCallback();
+
+protected:
+  // a compound holding all the shapes
+  TopoDS_Compound makeCompound() const;
+
+  // progression of the writer, value in [0,1]
+  void setProgress(double value, const char* phase);
+
+  std::list<TopoDS_Shape> m_shapes;
+  std::string m_output;  // the file when no file name is given
+  int retValue;
+  std::string message;
+};
+
+TopoDS_Compound ShapeWriteWorker::makeCompound() const
+{
+  BRep_Builder B;
+  TopoDS_Compound C;
+  B.MakeCompound(C);
+  for (std::list<TopoDS_Shape>::const_iterator it = m_shapes.begin(); it != m_shapes.end(); it++) {
+    B.Add(C, *it);
+  }
+  return C;
+}
+
+void ShapeWriteWorker::setProgress(double value, const char* phase)
+{
+  m_data.m_phase = phase;
+  m_data.m_percent = value * 100.0;
+  m_data.m_progress = value;
+  m_data.m_lastValue = value;
+  send_notify_progress();
+}
+
+void ShapeWriteWorker::HandleOKCallback()
+{
+  if (retValue == 0) {
+    v8::Local<v8::Value> result;
+    if (_filename.empty()) {
+      result = copyToBuffer(m_output);
+    } else {
+      result = Nan::New<v8::Boolean>(true);
+    }
+    v8::Local<v8::Value> argv[2] = { Nan::New<v8::Integer>(0), result };
+    callback->Call(2, argv);
+  } else {
+    v8::Local<v8::Value> argv[2] = {
+      Nan::New<v8::Integer>(retValue),
+      v8::Local<v8::Value>(Nan::New(message.c_str()).ToLocalChecked())
+    };
+    callback->Call(2, argv);
+  }
+}
 
+class MutexLocker
+{
+  uv_mutex_t& m_mutex;
+public:
+  MutexLocker(uv_mutex_t& mutex)
+    :m_mutex(mutex)
+  {
+    uv_mutex_lock(&m_mutex);
+  }
+  ~MutexLocker()
+  {
+    uv_mutex_unlock(&m_mutex);
+  }
+};
+
+//
+// the STEP translations ( imports and exports ) run one after the other : each
+// of them has its own reader or writer and work session, but they share the
+// actors of the STEP controller, the Interface_Static parameters and the unit
+// factors of the translator.
+//
+class StepTranslatorMutex
+{
+  uv_mutex_t m_mutex;
+
+  StepTranslatorMutex()
+  {
+    uv_mutex_init(&m_mutex);
+  }
+public:
+  static StepTranslatorMutex& instance()
+  {
+    static StepTranslatorMutex mutex;
+    return mutex;
+  }
+  uv_mutex_t& mutex()
+  {
+    return m_mutex;
+  }
+};
+
+// held by a STEP reader or writer while it uses the translator
+class StepTranslatorSlot
+{
+  uv_mutex_t& m_mutex;
+  bool m_acquired;
+public:
+  // waits until the translator is free, unless wait is false : acquired()
+  // then tells whether the translator was free
+  explicit StepTranslatorSlot(bool wait = true)
+    : m_mutex(StepTranslatorMutex::instance().mutex())
+    , m_acquired(true)
+  {
+    if (wait) {
+      uv_mutex_lock(&m_mutex);
+    } else {
+      m_acquired = uv_mutex_trylock(&m_mutex) == 0;
+    }
+  }
+  ~StepTranslatorSlot()
+  {
+    if (m_acquired) {
+      uv_mutex_unlock(&m_mutex);
+    }
+  }
+  bool acquired() const
+  {
+    return m_acquired;
+  }
+};
+
+static uv_once_t stepStaticParameters_once = UV_ONCE_INIT;
+
+static void initStepStaticParameters()
+{
+  STEPControl_Controller::Init();
+  Interface_Static::SetCVal("xstep.cascade.unit", "mm");
+  Interface_Static::SetIVal("read.step.nonmanifold", 1);
+  Interface_Static::SetIVal("read.step.product.mode", 1);
+}
+
+void writeSTEPAsync(const std::string& filename, const std::list<Shape*>& shapes,
+                    v8::Local<v8::Function> callback, v8::Local<v8::Function> progressCallback);
+void writeBREPAsync(const std::string& filename, const std::list<Shape*>& shapes,
+                    v8::Local<v8::Function> callback, v8::Local<v8::Function> progressCallback);
+
+/**
+ * writeSTEP(filename | null, solids... [, callback [, progressCallback]])
+ *  without callback, the file is written in the main loop and true is returned.
+ *  with a callback, the file is written in a working thread and callback(err, true)
+ *  is called, progressCallback(step, percent, phase) with phase "transfer" or "writing".
+ *  when filename is null, a Buffer holding the file is returned ( or given to the
+ *  callback ) instead of true.
+ *  the STEP translator is used by one import or export at a time : without callback,
+ *  an error is thrown while a STEP import or export runs in a working thread, the
+ *  main loop never waits for it ( use the callback form in that case ).
+ */
+NAN_METHOD(writeSTEP)
+{
+  std::string filename;
+  if (!extractFileName(info[0], filename) && !info[0]->IsNull() && !info[0]->IsUndefined()) {
+    return Nan::ThrowError("expecting a file name or null");
+  }
+
+  std::list<Shape*>  shapes;
+  v8::Local<v8::Object> options;
+  v8::Local<v8::Function> callback;
+  v8::Local<v8::Function> progressCallback;
+  extractWriterArguments(info, shapes, options, callback, progressCallback);
+
+  if (!callback.IsEmpty()) {
+    if (shapes.size() == 0) {
+      return Nan::ThrowError("expecting at least one solid");
+    }
+    writeSTEPAsync(filename, shapes, callback, progressCallback);
+    return;
+  }
   if (shapes.size() == 0) {
     return info.GetReturnValue().Set(Nan::New<v8::Boolean>(false));
   }
 
+  uv_once(&stepStaticParameters_once, initStepStaticParameters);
+  StepTranslatorSlot _slot(false);
+  if (!_slot.acquired()) {
+    return Nan::ThrowError("a STEP import or export is running : use writeSTEP with a callback");
+  }
+
+  std::string output;
   try {
     STEPControl_Writer writer;
     IFSelect_ReturnStatus status;
@@ -81,27 +333,53 @@ NAN_METHOD(writeSTEP)
         return Nan::ThrowError("Failed to write STEP file");
       }
     }
-    status = writer.Write(filename.c_str());
+    if (filename.empty()) {
+      std::ostringstream out;
+      if (!writeStepStream(writer, out)) {
+        return Nan::ThrowError("Failed to write STEP buffer");
+      }
+      output = out.str();
+    } else {
+      status = writer.Write(filename.c_str());
+    }
   } CATCH_AND_RETHROW("Failed to write STEP file ");
 
+  if (filename.empty()) {
+    return info.GetReturnValue().Set(copyToBuffer(output));
+  }
   info.GetReturnValue().Set(Nan::New<v8::Boolean>(true));
 }
 
+/**
+ * writeBREP(filename | null, solids... [, callback [, progressCallback]])
+ *  the solids are written as a compound, in a working thread when a
+ *  callback is given, or in a Buffer when filename is null ( see writeSTEP ).
+ */
 NAN_METHOD(writeBREP)
 {
   std::string filename;
-  if (!extractFileName(info[0], filename)) {
-    return Nan::ThrowError("expecting a file name");
+  if (!extractFileName(info[0], filename) && !info[0]->IsNull() && !info[0]->IsUndefined()) {
+    return Nan::ThrowError("expecting a file name or null");
   }
   std::list<Shape*>  shapes;
-  for (int i = 1; i < info.Length(); i++) {
-    extractShapes(info[i], shapes);
+  v8::Local<v8::Object> options;
+  v8::Local<v8::Function> callback;
+  v8::Local<v8::Function> progressCallback;
+  extractWriterArguments(info, shapes, options, callback, progressCallback);
+
+  if (!callback.IsEmpty()) {
+    if (shapes.size() == 0) {
+      return Nan::ThrowError("expecting at least one solid");
+    }
+    writeBREPAsync(filename, shapes, callback, progressCallback);
+    return;
   }
   if (shapes.size() == 0) {
     info.GetReturnValue().Set(Nan::New<v8::Boolean>(false));
     return;
   }
 
+  std::string output;
   try {
     BRep_Builder B;
     TopoDS_Compound C;
@@ -110,11 +388,50 @@ NAN_METHOD(writeBREP)
       TopoDS_Shape shape = (*it)->shape();
       B.Add(C, shape);
     }
-    BRepTools::Write(C, filename.c_str());
+    if (filename.empty()) {
+      std::ostringstream out;
+      BRepTools::Write(C, out);
+      output = out.str();
+    } else {
+      BRepTools::Write(C, filename.c_str());
+    }
   } CATCH_AND_RETHROW("Failed to write BREP file ");
+
+  if (filename.empty()) {
+    return info.GetReturnValue().Set(copyToBuffer(output));
+  }
   info.GetReturnValue().Set(Nan::New<v8::Boolean>(true));
 }
 
+void writeSTLAsync(const std::string& filename, const std::list<Shape*>& shapes, v8::Local<v8::Object> options,
+                   v8::Local<v8::Function> callback, v8::Local<v8::Function> progressCallback);
+
+static bool readSTLOptions(v8::Local<v8::Object> options, MeshParameters& params, STLWriterOptions& stlOptions)
+{
+  if (options.IsEmpty()) {
+    return true;
+  }
+  params.deflection = ReadDouble(options, "deflection", params.deflection);
+  params.angle = ReadDouble(options, "angle", params.angle);
+  if (!ReadMeshParameters(options, params)) {
+    return false;
+  }
+  stlOptions.parallel = ReadBool(options, "parallel", stlOptions.parallel);
+  stlOptions.bufferTriangles = (size_t)std::max(1, ReadInt(options, "bufferTriangles", (int)stlOptions.bufferTriangles));
+  return true;
+}
+
+/**
+ * writeSTL(filename, solids... [, options, callback [, progressCallback]])
+ *  the solids are triangulated as a whole and written as a binary STL ( see writeBinarySTL ).
+ *  without callback, the solids are meshed and written in the main loop and keep their
+ *  triangulation.
+ *  with a callback, a copy of the solids is written in a working thread and
+ *  callback(err, true) is called : the faces that are already triangulated ( by
+ *  createMesh for instance ) are written as they are, the other ones are meshed.
+ *  options : { deflection: 0.5, angle: 20 degrees in radians, parallel: false, bufferTriangles: 65536 }
+ *            ( see createMesh for the deflection modes )
+ */
 NAN_METHOD(writeSTL)
 {
   std::string filename;
@@ -122,31 +439,315 @@ NAN_METHOD(writeSTL)
     return Nan::ThrowError("expecting a file name");
   }
   std::list<Shape*>  shapes;
-  for (int i = 1; i < info.Length(); i++) {
-    extractShapes(info[i], shapes);
+  v8::Local<v8::Object> options;
+  v8::Local<v8::Function> callback;
+  v8::Local<v8::Function> progressCallback;
+  extractWriterArguments(info, shapes, options, callback, progressCallback);
+
+  if (!callback.IsEmpty()) {
+    if (shapes.size() == 0) {
+      return Nan::ThrowError("expecting at least one solid");
+    }
+    writeSTLAsync(filename, shapes, options, callback, progressCallback);
+    return;
   }
   if (shapes.size() == 0) {
     info.GetReturnValue().Set(Nan::New<v8::Boolean>(false));
     return;
   }
+  MeshParameters params;
+  STLWriterOptions stlOptions;
+  if (!readSTLOptions(options, params, stlOptions)) {
+    return;
+  }
+  bool written = false;
   try {
     BRep_Builder B;
     TopoDS_Compound C;
     B.MakeCompound(C);
+    std::vector<TopoDS_Face> faces;
     for (std::list<Shape*>::iterator it = shapes.begin(); it != shapes.end(); it++) {
       TopoDS_Shape shape = (*it)->shape();
       B.Add(C, shape);
+      collectMeshFaces(shape, faces);
+    }
+    triangulateShape(C, resolveDeflection(C, params));
+
+    std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+    if (out) {
+      writeBinarySTL(out, faces, stlOptions);
     }
-    StlAPI_Writer writer;
-    writer.ASCIIMode() = Standard_False;
-    writer.Write(C, filename.c_str(), Standard_True);
+    written = out ? true : false;
 
   } CATCH_AND_RETHROW("Failed to write STL file ");
+  if (!written) {
+    return Nan::ThrowError(("cannot write STL file " + filename).c_str());
+  }
   info.GetReturnValue().Set(Nan::New<v8::Boolean>(true));
 }
 
 
 
+//
+// meshes the shapes and writes them as a binary glTF in a working thread.
+// the distinct solids are found on the main thread ( see collectInstances ) and
+// each of them is copied there ( see MeshShapeCopy ) : the working thread meshes
+// the copies, the meshes keep the hash codes of the faces of the shapes.
+//
+class GLBWriteWorker : public ShapeWriteWorker {
+public:
+  GLBWriteWorker(Nan::Callback *callback, Nan::Callback* progressCallback, std::string* pfilename,
+                 const std::list<Shape*>& shapes, const MeshParameters& params, bool facePrimitives)
+    : ShapeWriteWorker(callback, progressCallback, pfilename, shapes)
+    , m_facePrimitives(facePrimitives)
+  {
+    const TopoDS_Compound C = makeCompound();
+    collectInstances(C, m_instances);
+    // relative deflections are resolved once for all the shapes
+    m_params = resolveDeflection(C, params);
+
+    m_prototypes.reserve(m_instances.prototypes.size());
+    for (size_t p = 0; p < m_instances.prototypes.size(); p++) {
+      m_prototypes.push_back(MeshShapeCopy(m_instances.prototypes[p]));
+    }
+  }
+  ~GLBWriteWorker() {
+    for (size_t i = 0; i < m_meshes.size(); i++) {
+      delete m_meshes[i];
+    }
+  }
+
+  void Execute();
+
+protected:
+  MeshParameters m_params;
+  bool m_facePrimitives;
+  MeshInstances m_instances;
+  std::vector<MeshShapeCopy> m_prototypes;
+  std::vector<Mesh*> m_meshes;
+};
+
+void GLBWriteWorker::Execute()
+{
+  retValue = 0;
+  try {
+    GLBWriter writer(m_facePrimitives);
+    const size_t nbPrototypes = m_prototypes.size();
+    for (size_t p = 0; p < nbPrototypes; p++) {
+      Mesh* mesh = new Mesh();
+      m_meshes.push_back(mesh);
+      meshShape(*mesh, m_prototypes[p], m_params);
+      mesh->optimize(m_params);
+      writer.addMesh(mesh);
+
+      m_data.m_percent = double(p + 1) * 100.0 / double(nbPrototypes);
+      m_data.m_progress = double(p + 1);
+      send_notify_progress();
+    }
+    for (size_t i = 0; i < m_instances.size(); i++) {
+      writer.addInstance(m_instances.prototypeIndex[i], &m_instances.matrices[16 * i]);
+    }
+
+    if (_filename.empty()) {
+      std::ostringstream out;
+      writer.write(out);
+      m_output = out.str();
+    } else {
+      std::ofstream out(_filename.c_str(), std::ios::out | std::ios::binary);
+      if (out) {
+        writer.write(out);
+      }
+      if (!out) {
+        message = "cannot write GLB file " + _filename;
+        retValue = 1;
+        return;
+      }
+    }
+  } catch (Standard_Failure&) {
+    Handle_Standard_Failure e = Standard_Failure::Caught();
+    Standard_CString msg = e->GetMessageString();
+    message = (msg != NULL && strlen(msg) > 1) ? msg : "Failed to write GLB file";
+    retValue = 1;
+  } catch (...) {
+    message = "caught C++ exception in writeGLB";
+    retValue = -3;
+  }
+}
+
+/**
+ * writeGLB(filename | null, solids..., [options,] callback [, progressCallback])
+ *  options : { deflection: 0.5, angle: 20 degrees in radians, facePrimitives: false }
+ *            and the options of Solid.createMesh.
+ *  the distinct solids are meshed once and written as glTF nodes with their matrix.
+ *  with facePrimitives, each face is a primitive of its own ( extras.hash is the face hash code ).
+ *  callback(err, true) when the file has been written, or callback(err, buffer)
+ *  with a Buffer holding the GLB file when filename is null.
+ */
+NAN_METHOD(writeGLB)
+{
+  std::string filename;
+  if (!extractFileName(info[0], filename) && !info[0]->IsNull() && !info[0]->IsUndefined()) {
+    return Nan::ThrowError("expecting a file name or null");
+  }
+
+  std::list<Shape*> shapes;
+  v8::Local<v8::Object> options;
+  v8::Local<v8::Function> callback;
+  v8::Local<v8::Function> progressCallback;
+  extractWriterArguments(info, shapes, options, callback, progressCallback);
+  if (callback.IsEmpty()) {
+    return Nan::ThrowError("expecting a callback function");
+  }
+  if (shapes.size() == 0) {
+    return Nan::ThrowError("expecting at least one solid");
+  }
+
+  MeshParameters params;
+  bool facePrimitives = false;
+  if (!options.IsEmpty()) {
+    params.deflection = ReadDouble(options, "deflection", params.deflection);
+    params.angle = ReadDouble(options, "angle", params.angle);
+    facePrimitives = ReadBool(options, "facePrimitives", facePrimitives);
+    if (!ReadMeshParameters(options, params)) {
+      return;
+    }
+  }
+  Nan::Callback* _callback = new Nan::Callback(callback);
+  Nan::Callback* _progressCallback = progressCallback.IsEmpty() ? NULL : new Nan::Callback(progressCallback);
+  Nan::AsyncQueueWorker(new GLBWriteWorker(_callback, _progressCallback, new std::string(filename),
+                                           shapes, params, facePrimitives));
+}
+
+
+// a copy of a triangulation for a copy of its face : a Poly_Triangulation
+// handle must not be shared between the main loop and a working thread
+static occHandle(Poly_Triangulation) duplicateTriangulation(const occHandle(Poly_Triangulation)& triangulation)
+{
+  occHandle(Poly_Triangulation) duplicate = triangulation->HasUVNodes()
+    ? new Poly_Triangulation(triangulation->Nodes(), triangulation->UVNodes(), triangulation->Triangles())
+    : new Poly_Triangulation(triangulation->Nodes(), triangulation->Triangles());
+  duplicate->Deflection(triangulation->Deflection());
+  return duplicate;
+}
+
+//
+// writes copies of the shapes as a binary STL file in a working thread
+// ( see writeBinarySTL ), the copies are made on the main thread and keep the
+// triangulation of the faces that have one : only the other faces are meshed.
+//
+class STLWriteWorker : public ShapeWriteWorker, public MeshProgressListener {
+public:
+  STLWriteWorker(Nan::Callback *callback, Nan::Callback* progressCallback, std::string* pfilename,
+                 const std::list<Shape*>& shapes, const MeshParameters& params, const STLWriterOptions& options)
+    : ShapeWriteWorker(callback, progressCallback, pfilename, shapes)
+    , m_params(params)
+    , m_options(options)
+  {
+    // BRepMesh stores the triangulation in the faces : the working thread meshes
+    // copies made here so that it never touches the shapes used by javascript.
+    // BRepBuilderAPI_Copy drops the triangulations, the existing ones are
+    // duplicated onto the faces of the copies so that they are written as is.
+    BRep_Builder builder;
+    for (std::list<TopoDS_Shape>::iterator it = m_shapes.begin(); it != m_shapes.end(); it++) {
+      BRepBuilderAPI_Copy copier(*it);
+      const TopoDS_Shape copy = copier.Shape();
+
+      std::vector<TopoDS_Face> faces;
+      collectMeshFaces(*it, faces);
+      std::vector<TopoDS_Face> copyFaces;
+      collectMeshFaces(copy, copyFaces);
+      for (size_t i = 0; i < faces.size() && i < copyFaces.size(); i++) {
+        TopLoc_Location loc;
+        const occHandle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(faces[i], loc);
+        if (!triangulation.IsNull()) {
+          builder.UpdateFace(copyFaces[i], duplicateTriangulation(triangulation));
+        }
+      }
+      *it = copy;
+    }
+  }
+
+  void Execute();
+
+  virtual void onFaceExtracted(size_t nbWrittenFaces, size_t nbFaces);
+
+protected:
+  MeshParameters m_params;
+  STLWriterOptions m_options;
+};
+
+void STLWriteWorker::Execute()
+{
+  retValue = 0;
+  try {
+    const TopoDS_Compound C = makeCompound();
+    std::vector<TopoDS_Face> faces;
+    for (std::list<TopoDS_Shape>::iterator it = m_shapes.begin(); it != m_shapes.end(); it++) {
+      collectMeshFaces(*it, faces);
+    }
+
+    // only the faces without triangulation are meshed, the others are written as they are
+    BRep_Builder builder;
+    TopoDS_Compound missingFaces;
+    builder.MakeCompound(missingFaces);
+    size_t nbMissingFaces = 0;
+    for (size_t i = 0; i < faces.size(); i++) {
+      TopLoc_Location loc;
+      if (BRep_Tool::Triangulation(faces[i], loc).IsNull()) {
+        builder.Add(missingFaces, faces[i]);
+        nbMissingFaces++;
+      }
+    }
+    if (nbMissingFaces > 0) {
+      triangulateShape(missingFaces, resolveDeflection(C, m_params));
+    }
+
+    std::ofstream out(_filename.c_str(), std::ios::out | std::ios::binary);
+    if (out) {
+      writeBinarySTL(out, faces, m_options, this);
+    }
+    if (!out) {
+      message = "cannot write STL file " + _filename;
+      retValue = 1;
+    }
+  } catch (Standard_Failure&) {
+    Handle_Standard_Failure e = Standard_Failure::Caught();
+    Standard_CString msg = e->GetMessageString();
+    message = (msg != NULL && strlen(msg) > 1) ? msg : "Failed to write STL file";
+    retValue = 1;
+  } catch (...) {
+    message = "caught C++ exception in writeSTL";
+    retValue = -3;
+  }
+}
+
+void STLWriteWorker::onFaceExtracted(size_t nbWrittenFaces, size_t nbFaces)
+{
+  double value = double(nbWrittenFaces) / double(nbFaces);
+  if (value - m_data.m_lastValue > 0.01 || nbWrittenFaces == nbFaces) {
+    m_data.m_percent  = value * 100.0;
+    m_data.m_progress = double(nbWrittenFaces);
+    m_data.m_lastValue = value;
+    send_notify_progress();
+  }
+}
+
+void writeSTLAsync(const std::string& filename, const std::list<Shape*>& shapes, v8::Local<v8::Object> options,
+                   v8::Local<v8::Function> _callback, v8::Local<v8::Function> _progressCallback)
+{
+  MeshParameters params;
+  STLWriterOptions stlOptions;
+  if (!readSTLOptions(options, params, stlOptions)) {
+    return;
+  }
+
+  Nan::Callback* callback = new Nan::Callback(_callback);
+  Nan::Callback* progressCallback = _progressCallback.IsEmpty() ? NULL : new Nan::Callback(_progressCallback);
+  Nan::AsyncQueueWorker(new STLWriteWorker(callback, progressCallback, new std::string(filename),
+                                           shapes, params, stlOptions));
+}
+
+
 static int extractSubShape(const TopoDS_Shape& shape, std::list<v8::Local<v8::Object> >& shapes)
 {
   TopAbs_ShapeEnum type = shape.ShapeType();
@@ -238,42 +839,36 @@ static v8::Local<v8::Array> convert(std::list<v8::Local<v8::Object> > & shapes)
 }
 
 
-bool mutex_initialised = false;
-uv_mutex_t stepOperation_mutex = { 0 };
-
-class MutexLocker
-{
-  uv_mutex_t& m_mutex;
-public:
-  MutexLocker(uv_mutex_t& mutex)
-    :m_mutex(mutex)
-  {
-    uv_mutex_lock(&m_mutex);
-  }
-  ~MutexLocker()
-  {
-    uv_mutex_unlock(&m_mutex);
-  }
-};
 
 
 
 
+//
+// forwards the progression of the OCC algorithms to the progress callback of
+// the worker : the notifications are coalesced so that at most one is sent
+// every interval milliseconds ( plus the forced ones and the last one ).
+// a user break is requested when the worker has been cancelled.
+//
 class MyProgressIndicator : public Message_ProgressIndicator
 {
   ProgressData* m_data;
   AsyncWorkerWithProgress* _worker;
+  uint64_t m_interval;  // in nanoseconds
+  uint64_t m_lastTime;
 public:
-  MyProgressIndicator(AsyncWorkerWithProgress* worker);
+  MyProgressIndicator(AsyncWorkerWithProgress* worker, double interval = 100);
 
   void notify_progress();
   virtual Standard_Boolean Show(const Standard_Boolean force);
+  virtual Standard_Boolean UserBreak();
 };
 
 
 
-MyProgressIndicator::MyProgressIndicator(AsyncWorkerWithProgress* worker)
+MyProgressIndicator::MyProgressIndicator(AsyncWorkerWithProgress* worker, double interval)
   :Message_ProgressIndicator(), _worker(worker)
+  , m_interval((uint64_t)(std::max(interval, 0.0) * 1E6))
+  , m_lastTime(0)
 {
   m_data = &_worker->m_data;
 }
@@ -283,16 +878,209 @@ Standard_Boolean MyProgressIndicator::Show(const Standard_Boolean force)
 {
 
   double value = this->GetPosition();
-  double delta = (value - this->m_data->m_lastValue);
+  const uint64_t now = uv_hrtime();
 
-  if (delta > 0.01) {
-    this->m_data->m_percent = value;
-    this->m_data->m_progress = int(delta * 1000);// this->GetPosition();
+  if (value != this->m_data->m_lastValue && (force || value >= 1.0 || now - m_lastTime >= m_interval)) {
+    this->m_data->m_percent = value * 100.0;
+    this->m_data->m_progress = value;
     this->m_data->m_lastValue = value;
-    //_worker->send_notify_progress();
+    m_lastTime = now;
+    _worker->send_notify_progress();
+  }
+  return UserBreak();
+}
+
+Standard_Boolean MyProgressIndicator::UserBreak()
+{
+  return _worker->cancelled() ? Standard_True : Standard_False;
+}
 
+
+//
+// returned by the asynchronous readers and by createMeshStream : handle.cancel()
+// asks the working thread to stop, the callback then receives an error.
+// the working thread only checks the request between two steps : the parse
+// of a STEP file ( ReadFile ) cannot be interrupted, a cancel sent while the
+// file is being read takes effect when the parse is over, before the transfer.
+//
+class CancelHandle : public node::ObjectWrap
+{
+  CancelFlag m_flag;
+public:
+  static Nan::Persistent<v8::FunctionTemplate> _template;
+
+  static NAN_METHOD(New);
+  static NAN_METHOD(cancel);
+
+  static v8::Local<v8::Object> NewInstance(const CancelFlag& flag);
+};
+
+Nan::Persistent<v8::FunctionTemplate> CancelHandle::_template;
+
+NAN_METHOD(CancelHandle::New)
+{
+  CancelHandle* obj = new CancelHandle();
+  obj->Wrap(info.This());
+  info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(CancelHandle::cancel)
+{
+  if (info.This().IsEmpty() || !IsInstanceOf<CancelHandle>(info.This())) {
+    return Nan::ThrowError("invalid object");
+  }
+  CancelHandle* pThis = node::ObjectWrap::Unwrap<CancelHandle>(info.This());
+  pThis->m_flag->store(true);
+}
+
+v8::Local<v8::Object> CancelHandle::NewInstance(const CancelFlag& flag)
+{
+  Nan::EscapableHandleScope scope;
+  if (_template.IsEmpty()) {
+    v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(CancelHandle::New);
+    tpl->SetClassName(Nan::New("CancelHandle").ToLocalChecked());
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+    v8::Local<v8::ObjectTemplate> proto = tpl->PrototypeTemplate();
+    EXPOSE_METHOD(CancelHandle, cancel);
+    _template.Reset(tpl);
   }
-  return Standard_False;
+  v8::Local<v8::Object> handle = Nan::New(_template)->GetFunction()->NewInstance(0, 0);
+  node::ObjectWrap::Unwrap<CancelHandle>(handle)->m_flag = flag;
+  return scope.Escape(handle);
+}
+
+v8::Local<v8::Object> newCancelHandle(const CancelFlag& flag)
+{
+  return CancelHandle::NewInstance(flag);
+}
+
+
+//
+// writes the shapes in a STEP file in a working thread ( see writeSTEP ).
+//
+class STEPWriteWorker : public ShapeWriteWorker {
+public:
+  STEPWriteWorker(Nan::Callback *callback, Nan::Callback* progressCallback, std::string* pfilename,
+                  const std::list<Shape*>& shapes)
+    : ShapeWriteWorker(callback, progressCallback, pfilename, shapes)
+  {
+  }
+
+  void Execute();
+};
+
+void STEPWriteWorker::Execute()
+{
+  retValue = 0;
+
+  uv_once(&stepStaticParameters_once, initStepStaticParameters);
+  StepTranslatorSlot _slot;
+
+  try {
+    STEPControl_Writer writer;
+    IFSelect_ReturnStatus status;
+
+    // the transfer takes most of the time
+    const double nbShapes = double(m_shapes.size());
+    int n = 0;
+    for (std::list<TopoDS_Shape>::iterator it = m_shapes.begin(); it != m_shapes.end(); it++) {
+      status = writer.Transfer(*it, STEPControl_AsIs);
+      if (status != IFSelect_RetDone) {
+        message = "Failed to write STEP file";
+        retValue = 1;
+        return;
+      }
+      setProgress(0.8 * double(++n) / nbShapes, "transfer");
+    }
+    setProgress(0.8, "writing");
+    if (_filename.empty()) {
+      std::ostringstream out;
+      if (!writeStepStream(writer, out)) {
+        message = "cannot write STEP buffer";
+        retValue = 1;
+        return;
+      }
+      m_output = out.str();
+    } else {
+      status = writer.Write(_filename.c_str());
+      if (status != IFSelect_RetDone) {
+        message = "cannot write STEP file " + _filename;
+        retValue = 1;
+        return;
+      }
+    }
+    setProgress(1.0, "writing");
+  } catch (Standard_Failure&) {
+    Handle_Standard_Failure e = Standard_Failure::Caught();
+    Standard_CString msg = e->GetMessageString();
+    message = (msg != NULL && strlen(msg) > 1) ? msg : "Failed to write STEP file";
+    retValue = 1;
+  } catch (...) {
+    message = "caught C++ exception in writeSTEP";
+    retValue = -3;
+  }
+}
+
+void writeSTEPAsync(const std::string& filename, const std::list<Shape*>& shapes,
+                    v8::Local<v8::Function> _callback, v8::Local<v8::Function> _progressCallback)
+{
+  Nan::Callback* callback = new Nan::Callback(_callback);
+  Nan::Callback* progressCallback = _progressCallback.IsEmpty() ? NULL : new Nan::Callback(_progressCallback);
+  Nan::AsyncQueueWorker(new STEPWriteWorker(callback, progressCallback, new std::string(filename), shapes));
+}
+
+
+//
+// writes the shapes as a compound in a BREP file in a working thread ( see writeBREP ).
+//
+class BREPWriteWorker : public ShapeWriteWorker {
+public:
+  BREPWriteWorker(Nan::Callback *callback, Nan::Callback* progressCallback, std::string* pfilename,
+                  const std::list<Shape*>& shapes)
+    : ShapeWriteWorker(callback, progressCallback, pfilename, shapes)
+  {
+  }
+
+  void Execute();
+};
+
+void BREPWriteWorker::Execute()
+{
+  retValue = 0;
+  try {
+    occHandle(Message_ProgressIndicator) progress = new MyProgressIndicator(this);
+    progress->SetScale(1, 100, 1);
+    m_data.m_phase = "writing";
+    progress->Show();
+
+    if (_filename.empty()) {
+      std::ostringstream out;
+      BRepTools::Write(makeCompound(), out, progress);
+      m_output = out.str();
+    } else if (!BRepTools::Write(makeCompound(), _filename.c_str(), progress)) {
+      message = "cannot write BREP file " + _filename;
+      retValue = 1;
+      return;
+    }
+    progress->SetValue(100.0);
+    progress->Show(Standard_True);
+  } catch (Standard_Failure&) {
+    Handle_Standard_Failure e = Standard_Failure::Caught();
+    Standard_CString msg = e->GetMessageString();
+    message = (msg != NULL && strlen(msg) > 1) ? msg : "Failed to write BREP file";
+    retValue = 1;
+  } catch (...) {
+    message = "caught C++ exception in writeBREP";
+    retValue = -3;
+  }
+}
+
+void writeBREPAsync(const std::string& filename, const std::list<Shape*>& shapes,
+                    v8::Local<v8::Function> _callback, v8::Local<v8::Function> _progressCallback)
+{
+  Nan::Callback* callback = new Nan::Callback(_callback);
+  Nan::Callback* progressCallback = _progressCallback.IsEmpty() ? NULL : new Nan::Callback(_progressCallback);
+  Nan::AsyncQueueWorker(new BREPWriteWorker(callback, progressCallback, new std::string(filename), shapes));
 }
 
 
@@ -302,10 +1090,49 @@ Standard_Boolean MyProgressIndicator::Show(const Standard_Boolean force)
 //http://free-cad.sourceforge.net/SrcDocu/df/d7b/ImportStep_8cpp_source.html
 
 
+//
+// the assembly structure and the names found in a STEP file.
+// the shapes are given by the hash codes of the sub-shapes of the result
+// ( the same product can be transferred as several shapes ).
+//
+struct StepAssembly {
+  struct Product {
+    std::string name;
+    std::vector<int> shapes;
+  };
+  // an occurrence of the child product in the parent product
+  struct Occurrence {
+    std::string name;
+    int parent;
+    int child;
+    std::vector<int> shapes;
+  };
+  std::vector<Product> products;
+  std::vector<Occurrence> occurrences;
+  std::unordered_map<int, int> productIndex;    // entity number in the model => index in products
+  std::unordered_map<int, std::string> names;   // hash code of a sub-shape => name of its representation item
+
+  int product(int entity, const std::string& name) {
+    std::unordered_map<int, int>::const_iterator it = productIndex.find(entity);
+    if (it != productIndex.end()) {
+      return it->second;
+    }
+    Product p;
+    p.name = name;
+    products.push_back(p);
+    productIndex[entity] = (int)products.size() - 1;
+    return (int)products.size() - 1;
+  }
+};
+
 class StepAsyncReadWorker : public AsyncWorkerWithProgress {
 public:
-  StepAsyncReadWorker(Nan::Callback *callback, Nan::Callback* progressCallback, std::string* pfilename)
+  StepAsyncReadWorker(Nan::Callback *callback, Nan::Callback* progressCallback, std::string* pfilename,
+                      double progressInterval = 100)
     : AsyncWorkerWithProgress(callback, progressCallback, pfilename)
+    , m_progressInterval(progressInterval)
+    , m_readTime(0)
+    , m_transferTime(0)
   {
   }
   ~StepAsyncReadWorker() {
@@ -318,9 +1145,67 @@ protected:
   int retValue;
   std::string message;
   std::list<TopoDS_Shape > shapes;
+
+  // stop when the worker has been cancelled, returns true if so
+  bool checkCancelled();
+  double m_progressInterval; // minimum delay between two progress notifications, in milliseconds
+  double m_readTime;       // in milliseconds
+  double m_transferTime;   // in milliseconds
+  StepAssembly assembly;
 };
 
 
+static v8::Local<v8::Array> convert(const std::vector<int>& hashes) {
+  v8::Local<v8::Array> arr = Nan::New<v8::Array>((int)hashes.size());
+  for (size_t i = 0; i < hashes.size(); i++) {
+    arr->Set((uint32_t)i, Nan::New<v8::Integer>(hashes[i]));
+  }
+  return arr;
+}
+
+//
+// the products that are not a component of another product, as trees of
+// { name, shapes: [hashCode...], components: [{ name, shapes, product }] }
+// ( a product used several times is the same javascript object )
+//
+static v8::Local<v8::Array> convert(const StepAssembly& assembly) {
+  std::vector<v8::Local<v8::Object> > products(assembly.products.size());
+  std::vector<v8::Local<v8::Array> > components(assembly.products.size());
+  std::vector<bool> isComponent(assembly.products.size(), false);
+  for (size_t p = 0; p < assembly.products.size(); p++) {
+    products[p] = Nan::New<v8::Object>();
+    components[p] = Nan::New<v8::Array>(0);
+    products[p]->Set(Nan::New("name").ToLocalChecked(), Nan::New(assembly.products[p].name.c_str()).ToLocalChecked());
+    products[p]->Set(Nan::New("shapes").ToLocalChecked(), convert(assembly.products[p].shapes));
+    products[p]->Set(Nan::New("components").ToLocalChecked(), components[p]);
+  }
+  for (size_t o = 0; o < assembly.occurrences.size(); o++) {
+    const StepAssembly::Occurrence& occurrence = assembly.occurrences[o];
+    v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+    obj->Set(Nan::New("name").ToLocalChecked(), Nan::New(occurrence.name.c_str()).ToLocalChecked());
+    obj->Set(Nan::New("shapes").ToLocalChecked(), convert(occurrence.shapes));
+    obj->Set(Nan::New("product").ToLocalChecked(), products[occurrence.child]);
+    components[occurrence.parent]->Set(components[occurrence.parent]->Length(), obj);
+    isComponent[occurrence.child] = true;
+  }
+  v8::Local<v8::Array> roots = Nan::New<v8::Array>(0);
+  for (size_t p = 0; p < assembly.products.size(); p++) {
+    if (!isComponent[p]) {
+      roots->Set(roots->Length(), products[p]);
+    }
+  }
+  return roots;
+}
+
+// { hashCode: name } for the named sub-shapes
+static v8::Local<v8::Object> convertNames(const StepAssembly& assembly) {
+  v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+  for (std::unordered_map<int, std::string>::const_iterator it = assembly.names.begin(); it != assembly.names.end(); it++) {
+    obj->Set(Nan::New<v8::Integer>(it->first), Nan::New(it->second.c_str()).ToLocalChecked());
+  }
+  return obj;
+}
+
 void StepAsyncReadWorker::HandleOKCallback() {
 
 
@@ -336,6 +1221,10 @@ void StepAsyncReadWorker::HandleOKCallback() {
       }
 
       v8::Local<v8::Array> arr = convert(jsshapes);
+      arr->Set(Nan::New("readTime").ToLocalChecked(), Nan::New<v8::Number>(m_readTime));
+      arr->Set(Nan::New("transferTime").ToLocalChecked(), Nan::New<v8::Number>(m_transferTime));
+      arr->Set(Nan::New("assembly").ToLocalChecked(), convert(assembly));
+      arr->Set(Nan::New("names").ToLocalChecked(), convertNames(assembly));
       v8::Local<v8::Value> err = Nan::New<v8::Integer>(0);
       v8::Local<v8::Value> argv[2] = { err, arr };
       callback->Call(2, argv);
@@ -360,29 +1249,179 @@ void StepAsyncReadWorker::HandleOKCallback() {
   }
 }
 
+// the sub-shapes of the result and their hash codes, indexed by their TShape
+// ( all the sub-shapes that are partners of a transferred shape share its TShape )
+typedef std::vector<std::pair<TopoDS_Shape, int> > StepSubShapes;
+typedef std::unordered_map<const Standard_Transient*, StepSubShapes> StepShapeIndex;
+
+static void indexSubShapes(const TopoDS_Shape& aResShape, StepShapeIndex& index)
+{
+  TopTools_IndexedMapOfShape anIndices;
+  TopExp::MapShapes(aResShape, anIndices);
+  for (int isub = 1; isub <= anIndices.Extent(); isub++) {
+    const TopoDS_Shape& aSub = anIndices.FindKey(isub);
+    index[aSub.TShape().operator->()].push_back(std::make_pair(aSub, aSub.HashCode(std::numeric_limits<int>::max())));
+  }
+}
+
+//
+// append the hash codes of the sub-shapes of the result that the entity has been
+// transferred to.
+// a product is shared by all its occurrences : all the partners of its shape are
+// found. an assembly occurrence is one placement of a product : only the sub-shapes
+// at the location of its shape ( IsSame ) are found.
+//
+static void findSubShapes(const StepShapeIndex& index,
+                          const occHandle(Transfer_TransientProcess)& TP,
+                          const occHandle(Standard_Transient)& enti,
+                          bool sameLocation, std::vector<int>& hashes)
+{
+  occHandle(Transfer_Binder) binder = TP->Find(enti);
+  if (binder.IsNull()) {
+    return;
+  }
+  TopoDS_Shape S = TransferBRep::ShapeResult(binder);
+  if (S.IsNull()) {
+    return;
+  }
+  StepShapeIndex::const_iterator it = index.find(S.TShape().operator->());
+  if (it == index.end()) {
+    return;
+  }
+  const StepSubShapes& subShapes = it->second;
+  for (size_t i = 0; i < subShapes.size(); i++) {
+    if (!sameLocation || subShapes[i].first.IsSame(S)) {
+      hashes.push_back(subShapes[i].second);
+    }
+  }
+}
+
+static std::string stepName(const occHandle(TCollection_HAsciiString)& aName)
+{
+  if (aName.IsNull() || aName->UsefullLength() < 1) {
+    return std::string();
+  }
+  // skip 'N0NE' name
+  if (aName->UsefullLength() == 4 && toupper(aName->Value(1)) == 'N' &&toupper(aName->Value(2)) == 'O' && toupper(aName->Value(3)) == 'N' && toupper(aName->Value(4)) == 'E') {
+    return std::string();
+  }
+  return std::string(aName->ToCString());
+}
+
+//
+// look for the products, the assembly occurrences and the representation items
+// transferred by the reader and find the sub-shapes of the result they name.
+// the entities are visited once and their shapes are found in the index.
+//
+static void extractStepNames(STEPControl_Reader& aReader, const StepShapeIndex& index, StepAssembly& assembly)
+{
+  occHandle(Interface_InterfaceModel) Model = aReader.WS()->Model();
+  occHandle(XSControl_TransferReader) TR = aReader.WS()->TransferReader();
+  if (TR.IsNull()) {
+    return;
+  }
+  occHandle(Transfer_TransientProcess) TP = TR->TransientProcess();
+  occHandle(Standard_Type) tPD = STANDARD_TYPE(StepBasic_ProductDefinition);
+  occHandle(Standard_Type) tNAUO = STANDARD_TYPE(StepRepr_NextAssemblyUsageOccurrence);
+  occHandle(Standard_Type) tShape = STANDARD_TYPE(StepShape_TopologicalRepresentationItem);
+  occHandle(Standard_Type) tGeom = STANDARD_TYPE(StepGeom_GeometricRepresentationItem);
+
+  const Interface_Graph& graph = aReader.WS()->Graph();
+
+  Standard_Integer nb = Model->NbEntities();
+  for (Standard_Integer ie = 1; ie <= nb; ie++) {
+
+    occHandle(Standard_Transient) enti = Model->Value(ie);
+
+    if (enti->DynamicType() == tNAUO) {
+      occHandle(StepRepr_NextAssemblyUsageOccurrence) NAUO = occHandle(StepRepr_NextAssemblyUsageOccurrence)::DownCast(enti);
+      if (NAUO.IsNull()) continue;
+
+      occHandle(TCollection_HAsciiString) aName;
+      Interface_EntityIterator subs = graph.Sharings(NAUO);
+      for (subs.Start(); subs.More(); subs.Next()) {
+        occHandle(StepRepr_ProductDefinitionShape) PDS = occHandle(StepRepr_ProductDefinitionShape)::DownCast(subs.Value());
+        if (PDS.IsNull()) continue;
+        occHandle(StepBasic_ProductDefinitionRelationship) PDR = PDS->Definition().ProductDefinitionRelationship();
+        if (PDR.IsNull()) continue;
+        if (PDR->HasDescription() && PDR->Description()->Length() > 0) {
+          aName = PDR->Description();
+        }
+        else if (PDR->Name()->Length() > 0) {
+          aName = PDR->Name();
+        }
+        else {
+          aName = PDR->Id();
+        }
+      }
+
+      occHandle(StepBasic_ProductDefinition) parent = NAUO->RelatingProductDefinition();
+      occHandle(StepBasic_ProductDefinition) child = NAUO->RelatedProductDefinition();
+      if (parent.IsNull() || child.IsNull()) continue;
+
+      StepAssembly::Occurrence o;
+      o.name = stepName(aName);
+      o.parent = assembly.product(Model->Number(parent), stepName(parent->Formation()->OfProduct()->Name()));
+      o.child = assembly.product(Model->Number(child), stepName(child->Formation()->OfProduct()->Name()));
+      findSubShapes(index, TP, enti, true, o.shapes);
+      assembly.occurrences.push_back(o);
+    }
+    else if (enti->DynamicType() == tPD) {
+      occHandle(StepBasic_ProductDefinition) PD = occHandle(StepBasic_ProductDefinition)::DownCast(enti);
+      if (PD.IsNull()) continue;
+      occHandle(StepBasic_Product) Prod = PD->Formation()->OfProduct();
+
+      const int product = assembly.product(ie, stepName(Prod->Name()));
+      findSubShapes(index, TP, enti, false, assembly.products[product].shapes);
+    }
+    else if (enti->IsKind(tShape) || enti->IsKind(tGeom)) {
+      const std::string name = stepName(occHandle(StepRepr_RepresentationItem)::DownCast(enti)->Name());
+      if (name.empty()) continue;
+
+      // as PRODUCT can be included in the main shape
+      // several times, all the inclusions are named.
+      std::vector<int> shapes;
+      findSubShapes(index, TP, enti, false, shapes);
+      for (size_t i = 0; i < shapes.size(); i++) {
+        assembly.names[shapes[i]] = name;
+      }
+    }
+  }
+}
+
+bool StepAsyncReadWorker::checkCancelled()
+{
+  if (!cancelled()) {
+    return false;
+  }
+  message = "the import has been cancelled";
+  retValue = 2;
+  return true;
+}
+
 void StepAsyncReadWorker::Execute() {
 
-  MutexLocker _locker(stepOperation_mutex);
+  uv_once(&stepStaticParameters_once, initStepStaticParameters);
+  StepTranslatorSlot _slot;
 
   void* data = request.data;
   retValue = 0;
 
-  occHandle(Message_ProgressIndicator) progress = new MyProgressIndicator(this);
+  occHandle(Message_ProgressIndicator) progress = new MyProgressIndicator(this, m_progressInterval);
 
   progress->SetScale(1, 100, 1);
   progress->Show();
 
   try {
 
-    STEPControl_Reader aReader;
-
-
-    Interface_Static::SetCVal("xstep.cascade.unit", "mm");
-    Interface_Static::SetIVal("read.step.nonmanifold", 1);
-    Interface_Static::SetIVal("read.step.product.mode", 1);
+    // a work session of its own : nothing is shared with the other imports
+    occHandle(XSControl_WorkSession) aSession = new XSControl_WorkSession();
+    STEPControl_Reader aReader(aSession, Standard_True);
 
+    m_data.m_phase = "reading";
     progress->NewScope(5, "reading");
 
+    uint64_t start = uv_hrtime();
     if (aReader.ReadFile(_filename.c_str()) != IFSelect_RetDone) {
 
       std::strstream str;
@@ -402,24 +1441,29 @@ void StepAsyncReadWorker::Execute() {
       return;
 
     }
+    m_readTime = double(uv_hrtime() - start) * 1E-6;
     progress->EndScope();
     progress->Show();
+    if (checkCancelled()) {
+      return;
+    }
 
-
-    progress->NewScope(95, "transfert");
+    m_data.m_phase = "transfer";
+    progress->NewScope(95, "transfer");
     progress->Show();
-    aReader.WS()->MapReader()->SetProgress(progress);
-
 
     // Root transfers
+    start = uv_hrtime();
     int nbr = aReader.NbRootsForTransfer();
 
     Standard_Boolean failsonly = Standard_False;
     aReader.PrintCheckTransfer(failsonly, IFSelect_ItemsByEntity);
 
+    std::vector<TopoDS_Shape> transferred;
+    aReader.WS()->MapReader()->SetProgress(progress);
     progress->SetRange(0, nbr);
     int mod = nbr / 10 + 1;
-    for (int n = 1; n <= nbr; n++) {
+    for (int n = 1; n <= nbr && !progress->UserBreak(); n++) {
 
       Standard_Boolean ok = aReader.TransferRoot(n);
 
@@ -429,21 +1473,27 @@ void StepAsyncReadWorker::Execute() {
       }
       if ((n + 1) % mod == 0) { progress->Increment(); }
     }
-
     aReader.WS()->MapReader()->SetProgress(0);
+
+    int nbs = aReader.NbShapes();
+    for (int i = 1; i <= nbs; i++) {
+      transferred.push_back(aReader.Shape(i));
+    }
+    m_transferTime = double(uv_hrtime() - start) * 1E-6;
+
     progress->EndScope();
-    progress->Show();
+    progress->Show(Standard_True);
+    if (checkCancelled()) {
+      return;
+    }
 
     TopoDS_Shape aResShape;
     BRep_Builder B;
     TopoDS_Compound compound;
     B.MakeCompound(compound);
 
-
-
-    int nbs = aReader.NbShapes();
-    for (int i = 1; i <= nbs; i++) {
-      const TopoDS_Shape& aShape = aReader.Shape(i);
+    for (size_t i = 0; i < transferred.size(); i++) {
+      const TopoDS_Shape& aShape = transferred[i];
       B.Add(compound, aShape);
 
       this->shapes.push_back(aShape);
@@ -451,119 +1501,9 @@ void StepAsyncReadWorker::Execute() {
 
     aResShape = compound;
 
-    TopTools_IndexedMapOfShape anIndices;
-    TopExp::MapShapes(aResShape, anIndices);
-
-    occHandle(Interface_InterfaceModel) Model = aReader.WS()->Model();
-    occHandle(XSControl_TransferReader) TR = aReader.WS()->TransferReader();
-
-    if (!TR.IsNull()) {
-      occHandle(Transfer_TransientProcess) TP = TR->TransientProcess();
-      occHandle(Standard_Type) tPD = STANDARD_TYPE(StepBasic_ProductDefinition);
-      occHandle(Standard_Type) tNAUO = STANDARD_TYPE(StepRepr_NextAssemblyUsageOccurrence);
-      occHandle(Standard_Type) tShape = STANDARD_TYPE(StepShape_TopologicalRepresentationItem);
-      occHandle(Standard_Type) tGeom = STANDARD_TYPE(StepGeom_GeometricRepresentationItem);
-
-      Standard_Integer nb = Model->NbEntities();
-
-      cout << " nb entities =" << nb << std::endl;
-
-      for (Standard_Integer ie = 1; ie <= nb; ie++) {
-
-        occHandle(Standard_Transient) enti = Model->Value(ie);
-
-        occHandle(TCollection_HAsciiString) aName;
-
-        if (enti->DynamicType() == tNAUO) {
-          occHandle(StepRepr_NextAssemblyUsageOccurrence) NAUO = occHandle(StepRepr_NextAssemblyUsageOccurrence)::DownCast(enti);
-          if (NAUO.IsNull()) continue;
-
-          Interface_EntityIterator subs = aReader.WS()->Graph().Sharings(NAUO);
-          for (subs.Start(); subs.More(); subs.Next()) {
-            occHandle(StepRepr_ProductDefinitionShape) PDS = occHandle(StepRepr_ProductDefinitionShape)::DownCast(subs.Value());
-            if (PDS.IsNull()) continue;
-            occHandle(StepBasic_ProductDefinitionRelationship) PDR = PDS->Definition().ProductDefinitionRelationship();
-            if (PDR.IsNull()) continue;
-            if (PDR->HasDescription() && PDR->Description()->Length() > 0) {
-              aName = PDR->Description();
-            }
-            else if (PDR->Name()->Length() > 0) {
-              aName = PDR->Name();
-            }
-            else {
-              aName = PDR->Id();
-            }
-          }
-          // find proper label
-          TCollection_ExtendedString str(aName->String());
-        }
-        else  if (enti->IsKind(tShape) || enti->IsKind(tGeom)) {
-          aName = occHandle(StepRepr_RepresentationItem)::DownCast(enti)->Name();
-        }
-        else if (enti->DynamicType() == tPD) {
-          occHandle(StepBasic_ProductDefinition) PD = occHandle(StepBasic_ProductDefinition)::DownCast(enti);
-          if (PD.IsNull()) continue;
-          occHandle(StepBasic_Product) Prod = PD->Formation()->OfProduct();
-          aName = Prod->Name();
-        }
-        else {
-          continue;
-        }
-        if (aName->UsefullLength() < 1)
-          continue;
-        // skip 'N0NE' name
-        if (aName->UsefullLength() == 4 && toupper(aName->Value(1)) == 'N' &&toupper(aName->Value(2)) == 'O' && toupper(aName->Value(3)) == 'N' && toupper(aName->Value(4)) == 'E')
-          continue;
-        /*
-        // special check to pass names like "Open CASCADE STEP translator 6.3 1"
-        TCollection_AsciiString aSkipName ("Open CASCADE STEP translator");
-        if (aName->Length() >= aSkipName.Length()) {
-        if (aName->String().SubString(1, aSkipName.Length()).IsEqual(aSkipName))
-        continue;
-        }
-
-        */
-        TCollection_ExtendedString aNameExt(aName->ToCString());
-
-        cout << " name of part =" << aName->ToCString() << std::endl;
-        // find target shape
-        occHandle(Transfer_Binder) binder = TP->Find(enti);
-        if (binder.IsNull()) continue;
-
-        TopoDS_Shape S = TransferBRep::ShapeResult(binder);
-        if (S.IsNull()) continue;
-
-        cout << " name of part = ---------" << std::endl;
-        // as PRODUCT can be included in the main shape
-        // several times, we look here for all iclusions.
-        Standard_Integer isub, nbSubs = anIndices.Extent();
-        for (isub = 1; isub <= nbSubs; isub++) {
-          TopoDS_Shape aSub = anIndices.FindKey(isub);
-          if (aSub.IsPartner(S)) {
-
-            cout << " name of part =" << aName->ToCString() << "  shape " << HashCode(aSub, -1) << " " << aSub.ShapeType() << endl;
-#if 0
-            // create label and set shape
-            if (L.IsNull()) {
-              TDF_TagSource aTag;
-              L = aTag.NewChild(theShapeLabel);
-              TNaming_Builder tnBuild(L);
-              //tnBuild.Generated(S);
-              tnBuild.Generated(aSub);
-            }
-            // set a name
-            TDataStd_Name::Set(L, aNameExt);
-#endif
-          }
-        }
-        //           }
-
-      }
-      // END: Store names
-    }
-    //
-    //
-    //
+    StepShapeIndex index;
+    indexSubShapes(aResShape, index);
+    extractStepNames(aReader, index, assembly);
   }
   catch (...) {
     std::cerr << " EXCEPTION in READ STEP" << std::endl;
@@ -575,6 +1515,7 @@ void StepAsyncReadWorker::Execute() {
 
 }
 
+
 //void _readStepAsyncAfter(uv_work_t *req,int status) {		
 //
 //  //xx TryCatch try_catch;
@@ -623,51 +1564,100 @@ void StepAsyncReadWorker::Execute() {
 //	uv_queue_work(uv_default_loop(), &data->req, _readStepAsync, _readStepAsyncAfter);
 //}
 
-void readStepAsync(const std::string& filename, v8::Local<v8::Function> _callback, v8::Local<v8::Function> _progressCallback)
+CancelFlag readStepAsync(const std::string& filename,
+                         v8::Local<v8::Function> _callback, v8::Local<v8::Function> _progressCallback,
+                         double progressInterval)
 {
   Nan::Callback* callback = new Nan::Callback(_callback);
   Nan::Callback* progressCallback = _progressCallback.IsEmpty() ? NULL : new Nan::Callback(_progressCallback);
   std::string* pfilename = new std::string(filename);
-  Nan::AsyncQueueWorker(new StepAsyncReadWorker(callback, progressCallback, pfilename));
+  StepAsyncReadWorker* worker = new StepAsyncReadWorker(callback, progressCallback, pfilename, progressInterval);
+  CancelFlag cancelFlag = worker->m_cancelled;
+  Nan::AsyncQueueWorker(worker);
+  return cancelFlag;
 }
 
+/**
+ * readSTEP(filename, [options,] callback [, progressCallback])
+ *  options : { progressInterval: 100 }
+ *  callback(err, shapes) : shapes.readTime and shapes.transferTime give the
+ *  duration of the two phases in milliseconds.
+ *  shapes.assembly is the tree of the products ( see convert(StepAssembly) ) and
+ *  shapes.names gives the name of the named sub-shapes by hash code.
+ *  progressCallback(step, percent, phase) is called at most every progressInterval
+ *  milliseconds, phase is "reading" or "transfer".
+ *  returns a handle : handle.cancel() stops the import, the callback then gets an error.
+ *  the parse of the file ( the "reading" phase ) cannot be interrupted : the import
+ *  stops at the end of the parse, or during the transfer of the roots.
+ *  the imports are serialized : several readSTEP calls run one after the other,
+ *  in a single working thread at a time ( see StepTranslatorMutex ).
+ *  a Buffer is rejected with an error, unlike readBREP : the STEP data must be in a file.
+ */
 NAN_METHOD(readSTEP)
 {
-  if (!mutex_initialised) { uv_mutex_init(&stepOperation_mutex); mutex_initialised = true; }
-
+  if (node::Buffer::HasInstance(info[0])) {
+    // the STEP parser of the OpenCascade versions this module builds against only reads files
+    return Nan::ThrowError("reading STEP data from a Buffer is not supported : write it to a file first");
+  }
   std::string filename;
   if (!extractFileName(info[0], filename)) {
     return Nan::ThrowError("expecting a file name");
   }
+  double progressInterval = 100;
+  int iCallback = 1;
+  if (info[1]->IsObject() && !info[1]->IsFunction()) {
+    v8::Local<v8::Object> options = info[1]->ToObject();
+    progressInterval = ReadDouble(options, "progressInterval", progressInterval);
+    iCallback = 2;
+  }
   v8::Local<v8::Function> callback;
-  if (!extractCallback(info[1], callback)) {
+  if (!extractCallback(info[iCallback], callback)) {
     return Nan::ThrowError("expecting a callback function");
   }
   v8::Local<v8::Function> progressCallback;
-  if (!extractCallback(info[2], progressCallback)) {
+  if (!extractCallback(info[iCallback + 1], progressCallback)) {
     // OPTIONAL !!!
     // Nan::ThrowError("expecting a callback function");
   }
 
-  readStepAsync(filename, callback, progressCallback);
+  CancelFlag cancelFlag = readStepAsync(filename, callback, progressCallback, progressInterval);
+  info.GetReturnValue().Set(CancelHandle::NewInstance(cancelFlag));
 }
 
 
 
 class BRepAsyncReadWorker : public StepAsyncReadWorker {
 public:
-  BRepAsyncReadWorker(Nan::Callback *callback, Nan::Callback* progressCallback, std::string* pfilename)
-    : StepAsyncReadWorker(callback, progressCallback, pfilename)
+  BRepAsyncReadWorker(Nan::Callback *callback, Nan::Callback* progressCallback, std::string* pfilename,
+                      double progressInterval = 100)
+    : StepAsyncReadWorker(callback, progressCallback, pfilename, progressInterval)
+    , m_source(0)
+    , m_sourceLength(0)
   {
   }
   ~BRepAsyncReadWorker() {
 
   }
 
+  // reads the content of a Buffer instead of a file, the buffer is
+  // kept alive by the worker and must not change until the callback.
+  // ( called in the main loop, before the worker is queued )
+  void setSource(v8::Local<v8::Object> buffer);
+
   void Execute();
 
+protected:
+  const char* m_source;    // content of the file when read from a Buffer
+  size_t m_sourceLength;
 };
 
+void BRepAsyncReadWorker::setSource(v8::Local<v8::Object> buffer)
+{
+  SaveToPersistent("source", buffer);
+  m_source = node::Buffer::Data(buffer);
+  m_sourceLength = node::Buffer::Length(buffer);
+}
+
 
 void BRepAsyncReadWorker::Execute()
 {
@@ -676,16 +1666,33 @@ void BRepAsyncReadWorker::Execute()
   std::string filename = this->_filename;
 
   try {
-    occHandle(Message_ProgressIndicator) progress = new MyProgressIndicator(this);
+    occHandle(Message_ProgressIndicator) progress = new MyProgressIndicator(this, m_progressInterval);
     progress->SetScale(1, 100, 1);
+    m_data.m_phase = "reading";
     progress->Show();
 
     // read brep-file
     TopoDS_Shape shape;
     BRep_Builder aBuilder;
-    if (!BRepTools::Read(shape, filename.c_str(), aBuilder, progress)) {
+    Standard_Boolean ok;
+    if (m_source) {
+      MemoryReadStreamBuf buffer(m_source, m_sourceLength);
+      std::istream in(&buffer);
+      BRepTools::Read(shape, in, aBuilder, progress);
+      ok = !shape.IsNull();
+    } else {
+      ok = BRepTools::Read(shape, filename.c_str(), aBuilder, progress);
+    }
+    if (checkCancelled()) {
+      return;
+    }
+    if (!ok) {
       std::strstream str;
-      str << " cannot read BREP file " << filename << std::ends;
+      if (m_source) {
+        str << " cannot read BREP data from buffer" << std::ends;
+      } else {
+        str << " cannot read BREP file " << filename << std::ends;
+      }
       std::cerr << str.str() << std::endl;
       this->message = str.str();
       this->retValue = 1;
@@ -695,7 +1702,7 @@ void BRepAsyncReadWorker::Execute()
     }
     this->shapes.push_back(shape);
     progress->SetValue(100.0);
-    progress->Show();
+    progress->Show(Standard_True);
   }
   catch (...) {
     this->message = "caught C++ exception in _readBREPAsync";
@@ -704,31 +1711,52 @@ void BRepAsyncReadWorker::Execute()
   }
 }
 
-void readBREPAsync(const std::string& filename, v8::Local<v8::Function> _callback, v8::Local<v8::Function> _progressCallback)
+CancelFlag readBREPAsync(const std::string& filename, v8::Local<v8::Object> source,
+                         v8::Local<v8::Function> _callback, v8::Local<v8::Function> _progressCallback,
+                         double progressInterval)
 {
   Nan::Callback* callback = new Nan::Callback(_callback);
   Nan::Callback* progressCallback = _progressCallback.IsEmpty() ? NULL : new Nan::Callback(_progressCallback);
   std::string* pfilename = new std::string(filename);
-  Nan::AsyncQueueWorker(new BRepAsyncReadWorker(callback, progressCallback, pfilename));
+  BRepAsyncReadWorker* worker = new BRepAsyncReadWorker(callback, progressCallback, pfilename, progressInterval);
+  if (!source.IsEmpty()) {
+    worker->setSource(source);
+  }
+  CancelFlag cancelFlag = worker->m_cancelled;
+  Nan::AsyncQueueWorker(worker);
+  return cancelFlag;
 }
 
 
+/**
+ * readBREP(filename | buffer, [options,] callback [, progressCallback])
+ *  options : { progressInterval: 100 }
+ *  returns a handle : handle.cancel() stops the import ( see readSTEP ).
+ */
 NAN_METHOD(readBREP)
 {
 
   std::string filename;
-  if (!extractFileName(info[0], filename)) {
-    return Nan::ThrowError("expecting a file name");
+  v8::Local<v8::Object> source;
+  if (!extractSource(info[0], filename, source)) {
+    return Nan::ThrowError("expecting a file name or a Buffer");
+  }
+  double progressInterval = 100;
+  int iCallback = 1;
+  if (info[1]->IsObject() && !info[1]->IsFunction()) {
+    progressInterval = ReadDouble(info[1]->ToObject(), "progressInterval", progressInterval);
+    iCallback = 2;
   }
   v8::Local<v8::Function> callback;
-  if (!extractCallback(info[1], callback)) {
+  if (!extractCallback(info[iCallback], callback)) {
     return Nan::ThrowError("expecting a callback function");
   }
   v8::Local<v8::Function> progressCallback;
-  if (!extractCallback(info[2], progressCallback)) {
+  if (!extractCallback(info[iCallback + 1], progressCallback)) {
     // return Nan::ThrowError("expecting a callback function");
   }
-  readBREPAsync(filename, callback, progressCallback);
+  CancelFlag cancelFlag = readBREPAsync(filename, source, callback, progressCallback, progressInterval);
+  info.GetReturnValue().Set(CancelHandle::NewInstance(cancelFlag));
 }
 #undef Handle
 
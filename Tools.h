@@ -1,8 +1,13 @@
 #include "OCC.h"
 #include "NodeV8.h"
+#include "AsyncWorkerWithProgress.h"
 
 NAN_METHOD(writeSTEP);
 NAN_METHOD(readSTEP);
 NAN_METHOD(writeBREP);
 NAN_METHOD(readBREP);
 NAN_METHOD(writeSTL);
+NAN_METHOD(writeGLB);
+
+// a javascript object whose cancel() method sets the flag ( see CancelHandle )
+v8::Local<v8::Object> newCancelHandle(const CancelFlag& flag);
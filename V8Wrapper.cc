@@ -4,6 +4,7 @@
 #include "BoundingBox.h"
 #include "Solid.h"
 #include "Mesh.h"
+#include "FaceMeshCache.h"
 #include "Edge.h"
 #include "Vertex.h"
 #include "Wire.h"
@@ -57,11 +58,16 @@ void Initialize(v8::Handle<v8::Object> target)
     Nan::SetMethod(target,"compound",ShapeFactory::compound);
 
     Nan::SetMethod(target,"writeSTL",writeSTL);
+    Nan::SetMethod(target,"writeGLB",writeGLB);
     Nan::SetMethod(target,"writeSTEP",writeSTEP);
     Nan::SetMethod(target,"writeBREP",writeBREP);
     Nan::SetMethod(target,"readSTEP",readSTEP);
     Nan::SetMethod(target,"readBREP",readBREP);
 
+    Nan::SetMethod(target,"meshCacheStatistics",meshCacheStatistics);
+    Nan::SetMethod(target,"setMeshCacheBudget",setMeshCacheBudget);
+    Nan::SetMethod(target,"clearMeshCache",clearMeshCache);
+
     //xx Nan::SetMethod(target,"oceVersion",NanNew("0.13"));
     target->Set(Nan::New("oceVersion").ToLocalChecked(),  Nan::New("0.13").ToLocalChecked());
 
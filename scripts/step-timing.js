@@ -0,0 +1,58 @@
+// times the two phases of readSTEP ( parsing and transfer ) on STEP files.
+//
+// usage : node scripts/step-timing.js [--runs n] file1.step [file2.step ...]
+//
+// each file is imported n times ( 3 by default ) and the best times are printed,
+// as a baseline for any change to the transfer of the roots.
+"use strict";
+const path = require("path");
+const occ = require(process.env.OCC_MODULE || path.join(__dirname, "..", "build", "Release", "occ"));
+
+function parseArguments(argv) {
+  const args = { runs: 3, files: [] };
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i] === "--runs") {
+      args.runs = Math.max(1, parseInt(argv[++i], 10));
+    } else {
+      args.files.push(argv[i]);
+    }
+  }
+  return args;
+}
+
+function readSTEP(filename) {
+  return new Promise(function (resolve, reject) {
+    occ.readSTEP(filename, function (err, shapes) {
+      if (err) {
+        return reject(new Error(filename + " : " + shapes));
+      }
+      resolve(shapes);
+    });
+  });
+}
+
+async function main() {
+  const args = parseArguments(process.argv.slice(2));
+  if (args.files.length < 1) {
+    console.log("usage : node scripts/step-timing.js [--runs n] file1.step [file2.step ...]");
+    process.exit(2);
+  }
+  for (const file of args.files) {
+    let readTime = Infinity;
+    let transferTime = Infinity;
+    let nbShapes = 0;
+    for (let run = 0; run < args.runs; run++) {
+      const shapes = await readSTEP(file);
+      readTime = Math.min(readTime, shapes.readTime);
+      transferTime = Math.min(transferTime, shapes.transferTime);
+      nbShapes = shapes.length;
+    }
+    console.log(path.basename(file) + " : " + nbShapes + " shapes, read " + readTime.toFixed(1) +
+                " ms, transfer " + transferTime.toFixed(1) + " ms");
+  }
+}
+
+main().catch(function (err) {
+  console.log(err.message);
+  process.exit(1);
+});
@@ -0,0 +1,111 @@
+#include "EdgeExtractor.h"
+
+#include <limits>
+
+static inline void pushPoint(std::vector<float>& positions, gp_Pnt pnt, const gp_Trsf& trsf, bool transformed)
+{
+  if (transformed) {
+    pnt.Transform(trsf);
+  }
+  positions.push_back(static_cast<float>(pnt.X()));
+  positions.push_back(static_cast<float>(pnt.Y()));
+  positions.push_back(static_cast<float>(pnt.Z()));
+}
+
+int discretizeEdge(const TopoDS_Edge& edge, double deflection, std::vector<float>& positions)
+{
+  const gp_Trsf identity;
+  BRepAdaptor_Curve curve_adaptor(edge);
+  GCPnts_UniformDeflection discretizer;
+  discretizer.Initialize(curve_adaptor, deflection);
+
+  int nbPoints = 0;
+  if (discretizer.IsDone() && discretizer.NbPoints() > 1) {
+    nbPoints = discretizer.NbPoints();
+    for (int i = 1; i <= nbPoints; i++) {
+      pushPoint(positions, discretizer.Value(i), identity, false);
+    }
+  } else {
+    // the ends of the edge
+    nbPoints = 2;
+    pushPoint(positions, curve_adaptor.Value(curve_adaptor.FirstParameter()), identity, false);
+    pushPoint(positions, curve_adaptor.Value(curve_adaptor.LastParameter()), identity, false);
+  }
+  return nbPoints;
+}
+
+// polygon of the edge created by the mesher, if fine enough
+static int reuseMeshPolygon(const TopoDS_Edge& edge, const TopTools_ListOfShape& faces, double deflection,
+                            std::vector<float>& positions)
+{
+  TopLoc_Location loc;
+
+  occHandle(Poly_Polygon3D) polygon = BRep_Tool::Polygon3D(edge, loc);
+  if (!polygon.IsNull() && polygon->Deflection() <= deflection) {
+    const gp_Trsf trsf = loc;
+    const TColgp_Array1OfPnt& nodes = polygon->Nodes();
+    for (int i = nodes.Lower(); i <= nodes.Upper(); i++) {
+      pushPoint(positions, nodes(i), trsf, !loc.IsIdentity());
+    }
+    return nodes.Length();
+  }
+
+  for (TopTools_ListIteratorOfListOfShape it(faces); it.More(); it.Next()) {
+    const TopoDS_Face& face = TopoDS::Face(it.Value());
+    occHandle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
+    if (triangulation.IsNull() || triangulation->Deflection() > deflection) {
+      continue;
+    }
+    occHandle(Poly_PolygonOnTriangulation) edgepoly = BRep_Tool::PolygonOnTriangulation(edge, triangulation, loc);
+    if (edgepoly.IsNull()) {
+      continue;
+    }
+    const gp_Trsf trsf = loc;
+    const TColgp_Array1OfPnt& nodes = triangulation->Nodes();
+    const TColStd_Array1OfInteger& indices = edgepoly->Nodes();
+    for (int i = indices.Lower(); i <= indices.Upper(); i++) {
+      pushPoint(positions, nodes(indices(i)), trsf, !loc.IsIdentity());
+    }
+    return indices.Length();
+  }
+  return 0;
+}
+
+void extractEdgePolylines(const TopoDS_Shape& shape, double deflection, EdgePolylines& polylines)
+{
+  polylines.positions.clear();
+  polylines.offsets.clear();
+  polylines.hashes.clear();
+  polylines.offsets.push_back(0);
+
+  if (shape.IsNull()) {
+    return;
+  }
+
+  // each edge is found once, with the faces it bounds
+  TopTools_IndexedDataMapOfShapeListOfShape edgeFaces;
+  TopExp::MapShapesAndAncestors(shape, TopAbs_EDGE, TopAbs_FACE, edgeFaces);
+
+  for (int e = 1; e <= edgeFaces.Extent(); e++) {
+    const TopoDS_Edge& edge = TopoDS::Edge(edgeFaces.FindKey(e));
+    const TopTools_ListOfShape& faces = edgeFaces.FindFromIndex(e);
+
+    if (BRep_Tool::Degenerated(edge)) {
+      continue;
+    }
+    bool seam = false;
+    for (TopTools_ListIteratorOfListOfShape it(faces); it.More() && !seam; it.Next()) {
+      seam = BRep_Tool::IsClosed(edge, TopoDS::Face(it.Value())) ? true : false;
+    }
+    if (seam) {
+      continue;
+    }
+
+    int nbPoints = reuseMeshPolygon(edge, faces, deflection, polylines.positions);
+    if (nbPoints == 0) {
+      nbPoints = discretizeEdge(edge, deflection, polylines.positions);
+    }
+    polylines.hashes.push_back(edge.HashCode(std::numeric_limits<int>::max()));
+    polylines.offsets.push_back(polylines.offsets.back() + nbPoints);
+  }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "OCC.h"
+
+#include <vector>
+
+// polylines of all the edges of a shape, in compressed rows :
+// the points of edge i are the points [offsets[i], offsets[i+1])
+// of positions ( 3 floats per point ).
+struct EdgePolylines {
+  std::vector<float> positions;
+  std::vector<unsigned int> offsets;
+  std::vector<int> hashes;       // hash code of each edge
+};
+
+// discretize the edges of a shape ( seams and degenerated edges are skipped ).
+// the polygons stored by the mesher ( Poly_Polygon3D, Poly_PolygonOnTriangulation )
+// are reused when they are at least as fine as the requested deflection.
+// Note: this function doesn't use V8 and can be called from a worker thread.
+void extractEdgePolylines(const TopoDS_Shape& shape, double deflection, EdgePolylines& polylines);
+
+// discretize one edge with the given deflection, returns the number of points
+int discretizeEdge(const TopoDS_Edge& edge, double deflection, std::vector<float>& positions);
@@ -0,0 +1,229 @@
+#include "FaceMeshCache.h"
+#include "MeshExtractor.h"
+#include "Util.h"
+
+#include <limits>
+
+// disabled until setMeshCacheBudget is called : the cached faces pin their
+// shapes, whose B-rep is not counted in the budget
+static const size_t kDefaultBudget = 0;
+
+FaceMeshCache& FaceMeshCache::instance()
+{
+  static FaceMeshCache cache;
+  return cache;
+}
+
+FaceMeshCache::FaceMeshCache()
+{
+  uv_mutex_init(&m_mutex);
+  m_statistics.hits = 0;
+  m_statistics.misses = 0;
+  m_statistics.evictions = 0;
+  m_statistics.entries = 0;
+  m_statistics.bytes = 0;
+  m_statistics.budget = kDefaultBudget;
+}
+
+FaceMeshCache::~FaceMeshCache()
+{
+  uv_mutex_destroy(&m_mutex);
+}
+
+size_t FaceMeshCache::hashKey(const TopoDS_Face& face, const MeshParameters& params)
+{
+  size_t h = (size_t)face.HashCode(std::numeric_limits<int>::max());
+  h = h * 31 + (size_t)face.Orientation();
+  h = h * 31 + std::hash<double>()(params.deflection);
+  h = h * 31 + std::hash<double>()(params.angle);
+  h = h * 31 + (params.qualityNormals ? 1 : 0);
+  h = h * 31 + (size_t)params.deflectionMode;
+  return h;
+}
+
+bool FaceMeshCache::matches(const Entry& entry, const TopoDS_Face& face, const MeshParameters& params)
+{
+  return entry.face.IsEqual(face)
+      && entry.deflection == params.deflection
+      && entry.angle == params.angle
+      && entry.qualityNormals == params.qualityNormals
+      && entry.deflectionMode == params.deflectionMode;
+}
+
+// the part and the triangulation it has been extracted from, which the entry keeps alive
+static size_t entryBytes(const FaceMeshCache::Part& part, const occHandle(Poly_Triangulation)& triangulation)
+{
+  size_t bytes = part->byteSize();
+  if (!triangulation.IsNull()) {
+    bytes += sizeof(Poly_Triangulation)
+           + (size_t)triangulation->NbNodes() * sizeof(gp_Pnt)
+           + (size_t)triangulation->NbTriangles() * sizeof(Poly_Triangle);
+    if (triangulation->HasUVNodes()) {
+      bytes += (size_t)triangulation->NbNodes() * sizeof(gp_Pnt2d);
+    }
+  }
+  return bytes;
+}
+
+FaceMeshCache::Part FaceMeshCache::find(const TopoDS_Face& face, const MeshParameters& params)
+{
+  TopLoc_Location loc;
+  occHandle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
+
+  const size_t hash = hashKey(face, params);
+  Part part;
+
+  uv_mutex_lock(&m_mutex);
+  typedef std::unordered_multimap<size_t, EntryList::iterator>::iterator IndexIterator;
+  std::pair<IndexIterator, IndexIterator> range = m_index.equal_range(hash);
+  for (IndexIterator it = range.first; it != range.second; ++it) {
+    EntryList::iterator entry = it->second;
+    if (!matches(*entry, face, params)) {
+      continue;
+    }
+    if (entry->triangulation != triangulation) {
+      // the face has been triangulated again
+      erase(entry);
+      break;
+    }
+    part = entry->part;
+    m_entries.splice(m_entries.begin(), m_entries, entry);
+    break;
+  }
+  if (part) {
+    m_statistics.hits++;
+  } else {
+    m_statistics.misses++;
+  }
+  uv_mutex_unlock(&m_mutex);
+  return part;
+}
+
+void FaceMeshCache::insert(const TopoDS_Face& face, const MeshParameters& params, const Part& part)
+{
+  Entry entry;
+  entry.face = face;
+  entry.deflection = params.deflection;
+  entry.angle = params.angle;
+  entry.qualityNormals = params.qualityNormals;
+  entry.deflectionMode = params.deflectionMode;
+  TopLoc_Location loc;
+  entry.triangulation = BRep_Tool::Triangulation(face, loc);
+  entry.part = part;
+  entry.bytes = entryBytes(part, entry.triangulation);
+  entry.hash = hashKey(face, params);
+
+  if (entry.triangulation.IsNull()) {
+    return;
+  }
+
+  uv_mutex_lock(&m_mutex);
+  if (entry.bytes <= m_statistics.budget) {
+    // replace an older entry for the same key
+    typedef std::unordered_multimap<size_t, EntryList::iterator>::iterator IndexIterator;
+    std::pair<IndexIterator, IndexIterator> range = m_index.equal_range(entry.hash);
+    for (IndexIterator it = range.first; it != range.second; ++it) {
+      if (matches(*it->second, face, params)) {
+        erase(it->second);
+        break;
+      }
+    }
+    m_entries.push_front(entry);
+    m_index.insert(std::make_pair(entry.hash, m_entries.begin()));
+    m_statistics.entries++;
+    m_statistics.bytes += entry.bytes;
+    evict();
+  }
+  uv_mutex_unlock(&m_mutex);
+}
+
+// must be called with the mutex locked
+void FaceMeshCache::erase(EntryList::iterator entry)
+{
+  typedef std::unordered_multimap<size_t, EntryList::iterator>::iterator IndexIterator;
+  std::pair<IndexIterator, IndexIterator> range = m_index.equal_range(entry->hash);
+  for (IndexIterator it = range.first; it != range.second; ++it) {
+    if (it->second == entry) {
+      m_index.erase(it);
+      break;
+    }
+  }
+  m_statistics.entries--;
+  m_statistics.bytes -= entry->bytes;
+  m_entries.erase(entry);
+}
+
+// must be called with the mutex locked
+void FaceMeshCache::evict()
+{
+  while (m_statistics.bytes > m_statistics.budget && !m_entries.empty()) {
+    EntryList::iterator last = m_entries.end();
+    --last;
+    erase(last);
+    m_statistics.evictions++;
+  }
+}
+
+void FaceMeshCache::setBudget(size_t bytes)
+{
+  uv_mutex_lock(&m_mutex);
+  m_statistics.budget = bytes;
+  evict();
+  uv_mutex_unlock(&m_mutex);
+}
+
+bool FaceMeshCache::enabled()
+{
+  uv_mutex_lock(&m_mutex);
+  bool enabled = m_statistics.budget > 0;
+  uv_mutex_unlock(&m_mutex);
+  return enabled;
+}
+
+void FaceMeshCache::clear()
+{
+  uv_mutex_lock(&m_mutex);
+  m_index.clear();
+  m_entries.clear();
+  m_statistics.entries = 0;
+  m_statistics.bytes = 0;
+  uv_mutex_unlock(&m_mutex);
+}
+
+FaceMeshCache::Statistics FaceMeshCache::statistics()
+{
+  uv_mutex_lock(&m_mutex);
+  Statistics statistics = m_statistics;
+  uv_mutex_unlock(&m_mutex);
+  return statistics;
+}
+
+
+NAN_METHOD(meshCacheStatistics)
+{
+  FaceMeshCache::Statistics statistics = FaceMeshCache::instance().statistics();
+
+  v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+  obj->Set(Nan::New("hits").ToLocalChecked(), Nan::New<v8::Number>((double)statistics.hits));
+  obj->Set(Nan::New("misses").ToLocalChecked(), Nan::New<v8::Number>((double)statistics.misses));
+  obj->Set(Nan::New("evictions").ToLocalChecked(), Nan::New<v8::Number>((double)statistics.evictions));
+  obj->Set(Nan::New("entries").ToLocalChecked(), Nan::New<v8::Number>((double)statistics.entries));
+  obj->Set(Nan::New("bytes").ToLocalChecked(), Nan::New<v8::Number>((double)statistics.bytes));
+  obj->Set(Nan::New("budget").ToLocalChecked(), Nan::New<v8::Number>((double)statistics.budget));
+  info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(setMeshCacheBudget)
+{
+  double bytes = 0;
+  if (info.Length() < 1 || !info[0]->IsNumber()) {
+    return Nan::ThrowError("expecting a number of bytes");
+  }
+  ReadDouble(info[0], bytes);
+  FaceMeshCache::instance().setBudget(bytes > 0 ? (size_t)bytes : 0);
+}
+
+NAN_METHOD(clearMeshCache)
+{
+  FaceMeshCache::instance().clear();
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "OCC.h"
+#include "NodeV8.h"
+#include "Mesh.h"
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <uv.h>
+
+struct MeshParameters;
+
+//
+// process-wide LRU cache of the meshes extracted for each face.
+// the key is the face ( TShape, location and orientation ) and the parameters
+// that change the extracted mesh ( resolved deflection and its mode, angle, normals mode ).
+// an entry is only valid as long as the face keeps the triangulation it has
+// been extracted from.
+// the budget counts the extracted meshes and the triangulations they come from,
+// but not the B-rep of the faces that the entries keep alive : the cache is
+// disabled by default ( budget 0 ).
+// the cache can be used from any thread, but only the synchronous meshing uses it :
+// the working threads mesh copies of the shapes, whose faces are never found again.
+//
+class FaceMeshCache {
+public:
+  typedef std::shared_ptr<Mesh> Part;
+
+  struct Statistics {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t entries;
+    size_t bytes;
+    size_t budget;
+  };
+
+  static FaceMeshCache& instance();
+
+  // mesh of a single face ( see Mesh::extractFaceMesh ), null if not cached
+  Part find(const TopoDS_Face& face, const MeshParameters& params);
+  void insert(const TopoDS_Face& face, const MeshParameters& params, const Part& part);
+
+  // a budget of 0 bytes disables the cache
+  void setBudget(size_t bytes);
+  bool enabled();
+  void clear();
+  Statistics statistics();
+
+private:
+  FaceMeshCache();
+  ~FaceMeshCache();
+
+  struct Entry {
+    TopoDS_Face face;
+    double deflection;
+    double angle;
+    bool qualityNormals;
+    int deflectionMode;
+    occHandle(Poly_Triangulation) triangulation;
+    Part part;
+    size_t bytes;
+    size_t hash;
+  };
+  typedef std::list<Entry> EntryList;
+
+  static size_t hashKey(const TopoDS_Face& face, const MeshParameters& params);
+  static bool matches(const Entry& entry, const TopoDS_Face& face, const MeshParameters& params);
+
+  void erase(EntryList::iterator it);
+  void evict();
+
+  uv_mutex_t m_mutex;
+  EntryList m_entries; // most recently used first
+  std::unordered_multimap<size_t, EntryList::iterator> m_index;
+  Statistics m_statistics;
+
+  FaceMeshCache(const FaceMeshCache&);
+  void operator=(const FaceMeshCache&);
+};
+
+// meshCacheStatistics() => { hits, misses, evictions, entries, bytes, budget }
+NAN_METHOD(meshCacheStatistics);
+// setMeshCacheBudget(bytes) ( 0 by default : the cache is disabled )
+NAN_METHOD(setMeshCacheBudget);
+// clearMeshCache()
+NAN_METHOD(clearMeshCache);
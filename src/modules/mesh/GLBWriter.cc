@@ -0,0 +1,239 @@
+#include "GLBWriter.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <assert.h>
+
+static const unsigned int kMagic     = 0x46546C67; // "glTF"
+static const unsigned int kVersion   = 2;
+static const unsigned int kChunkJSON = 0x4E4F534A; // "JSON"
+static const unsigned int kChunkBIN  = 0x004E4942; // "BIN\0"
+
+// glTF constants
+static const int kFloat          = 5126;
+static const int kUnsignedInt    = 5125;
+static const int kArrayBuffer    = 34962;
+static const int kElementBuffer  = 34963;
+static const int kTriangles      = 4;
+
+static void writeUint32(std::ostream& out, unsigned int value)
+{
+  // GLB is little endian whatever the platform
+  const char bytes[4] = {
+    (char)(value & 0xFF), (char)((value >> 8) & 0xFF),
+    (char)((value >> 16) & 0xFF), (char)((value >> 24) & 0xFF)
+  };
+  out.write(bytes, 4);
+}
+
+static bool isIdentity(const double* m)
+{
+  for (int i = 0; i < 16; i++) {
+    if (m[i] != ((i % 5) == 0 ? 1.0 : 0.0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+GLBWriter::GLBWriter(bool facePrimitives)
+  : m_facePrimitives(facePrimitives)
+  , m_laidOut(false)
+  , m_binLength(0)
+{
+}
+
+int GLBWriter::addMesh(const Mesh* mesh)
+{
+  m_laidOut = false;
+  m_meshes.push_back(mesh);
+  return (int)m_meshes.size() - 1;
+}
+
+void GLBWriter::addInstance(int mesh, const double* matrix)
+{
+  assert(mesh >= 0 && mesh < (int)m_meshes.size());
+  m_laidOut = false;
+  m_instanceMesh.push_back(mesh);
+  m_hasMatrix.push_back(matrix != 0 && !isIdentity(matrix));
+  for (int i = 0; i < 16; i++) {
+    m_matrices.push_back(matrix ? matrix[i] : ((i % 5) == 0 ? 1.0 : 0.0));
+  }
+}
+
+//
+// builds the JSON chunk : the binary chunk holds, for each mesh that has
+// triangles, its vertices, its normals and its triangles one after the other.
+//
+void GLBWriter::layout()
+{
+  std::ostringstream bufferViews;
+  std::ostringstream accessors;
+  std::ostringstream meshes;
+  std::ostringstream nodes;
+  std::ostringstream sceneNodes;
+  accessors << std::setprecision(9);
+  nodes << std::setprecision(17);
+
+  std::vector<int> gltfMesh(m_meshes.size(), -1);
+  size_t offset = 0;
+  int nbBufferViews = 0;
+  int nbAccessors = 0;
+  int nbMeshes = 0;
+
+  for (size_t m = 0; m < m_meshes.size(); m++) {
+    const Mesh& mesh = *m_meshes[m];
+    const size_t nbVertices = mesh.vertices.size();
+    const size_t nbTriangles = mesh.triangles.size();
+    if (nbVertices == 0 || nbTriangles == 0) {
+      continue; // glTF doesn't allow empty accessors
+    }
+    const size_t vertexBytes = nbVertices * sizeof(Coord3f);
+    const size_t triangleBytes = nbTriangles * sizeof(Triangle3i);
+
+    float bmin[3] = { mesh.vertices[0].x, mesh.vertices[0].y, mesh.vertices[0].z };
+    float bmax[3] = { bmin[0], bmin[1], bmin[2] };
+    for (size_t v = 1; v < nbVertices; v++) {
+      const float p[3] = { mesh.vertices[v].x, mesh.vertices[v].y, mesh.vertices[v].z };
+      for (int c = 0; c < 3; c++) {
+        bmin[c] = std::min(bmin[c], p[c]);
+        bmax[c] = std::max(bmax[c], p[c]);
+      }
+    }
+
+    const int positionView = nbBufferViews++;
+    const int normalView = nbBufferViews++;
+    const int indexView = nbBufferViews++;
+    bufferViews << (positionView ? "," : "")
+                << "{\"buffer\":0,\"byteOffset\":" << offset << ",\"byteLength\":" << vertexBytes
+                << ",\"target\":" << kArrayBuffer << "},"
+                << "{\"buffer\":0,\"byteOffset\":" << offset + vertexBytes << ",\"byteLength\":" << vertexBytes
+                << ",\"target\":" << kArrayBuffer << "},"
+                << "{\"buffer\":0,\"byteOffset\":" << offset + 2 * vertexBytes << ",\"byteLength\":" << triangleBytes
+                << ",\"target\":" << kElementBuffer << "}";
+    offset += 2 * vertexBytes + triangleBytes;
+
+    const int positionAccessor = nbAccessors++;
+    const int normalAccessor = nbAccessors++;
+    accessors << (positionAccessor ? "," : "")
+              << "{\"bufferView\":" << positionView << ",\"componentType\":" << kFloat
+              << ",\"count\":" << nbVertices << ",\"type\":\"VEC3\""
+              << ",\"min\":[" << bmin[0] << "," << bmin[1] << "," << bmin[2] << "]"
+              << ",\"max\":[" << bmax[0] << "," << bmax[1] << "," << bmax[2] << "]},"
+              << "{\"bufferView\":" << normalView << ",\"componentType\":" << kFloat
+              << ",\"count\":" << nbVertices << ",\"type\":\"VEC3\"}";
+
+    std::ostringstream primitives;
+    const bool perFace = m_facePrimitives && !mesh.faceranges.empty();
+    int nbPrimitives = 0;
+    const size_t nbRanges = perFace ? mesh.faceranges.size() : 1;
+    for (size_t f = 0; f < nbRanges; f++) {
+      size_t firstTriangle = 0;
+      size_t count = nbTriangles;
+      if (perFace) {
+        const MeshFaceRange& range = mesh.faceranges[f];
+        if (range.nbTriangles == 0) {
+          continue;
+        }
+        firstTriangle = (size_t)range.firstTriangle;
+        count = (size_t)range.nbTriangles;
+      }
+      const int indexAccessor = nbAccessors++;
+      accessors << ",{\"bufferView\":" << indexView << ",\"byteOffset\":" << firstTriangle * sizeof(Triangle3i)
+                << ",\"componentType\":" << kUnsignedInt << ",\"count\":" << count * 3
+                << ",\"type\":\"SCALAR\"}";
+
+      primitives << (nbPrimitives ? "," : "")
+                 << "{\"attributes\":{\"POSITION\":" << positionAccessor << ",\"NORMAL\":" << normalAccessor << "}"
+                 << ",\"indices\":" << indexAccessor << ",\"material\":0,\"mode\":" << kTriangles;
+      if (perFace) {
+        primitives << ",\"extras\":{\"hash\":" << mesh.faceranges[f].hash << "}";
+      }
+      primitives << "}";
+      nbPrimitives++;
+    }
+
+    meshes << (nbMeshes ? "," : "") << "{\"primitives\":[" << primitives.str() << "]}";
+    gltfMesh[m] = nbMeshes++;
+  }
+
+  int nbNodes = 0;
+  for (size_t i = 0; i < m_instanceMesh.size(); i++) {
+    const int mesh = gltfMesh[m_instanceMesh[i]];
+    if (mesh < 0) {
+      continue;
+    }
+    nodes << (nbNodes ? "," : "") << "{\"mesh\":" << mesh;
+    if (m_hasMatrix[i]) {
+      nodes << ",\"matrix\":[";
+      for (int j = 0; j < 16; j++) {
+        nodes << (j ? "," : "") << m_matrices[16 * i + j];
+      }
+      nodes << "]";
+    }
+    nodes << "}";
+    sceneNodes << (nbNodes ? "," : "") << nbNodes;
+    nbNodes++;
+  }
+
+  std::ostringstream json;
+  json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"node-occ\"}"
+       << ",\"scene\":0,\"scenes\":[{\"nodes\":[" << sceneNodes.str() << "]}]"
+       << ",\"nodes\":[" << nodes.str() << "]"
+       << ",\"materials\":[{\"pbrMetallicRoughness\":{\"baseColorFactor\":[0.8,0.8,0.8,1],"
+       << "\"metallicFactor\":0,\"roughnessFactor\":0.5}}]";
+  if (nbMeshes > 0) {
+    json << ",\"meshes\":[" << meshes.str() << "]"
+         << ",\"accessors\":[" << accessors.str() << "]"
+         << ",\"bufferViews\":[" << bufferViews.str() << "]"
+         << ",\"buffers\":[{\"byteLength\":" << offset << "}]";
+  }
+  json << "}";
+
+  m_json = json.str();
+  while (m_json.size() % 4) {
+    m_json += ' ';
+  }
+  // all the components are 4 bytes long : the binary chunk is aligned
+  m_binLength = offset;
+  m_laidOut = true;
+}
+
+size_t GLBWriter::byteLength()
+{
+  if (!m_laidOut) {
+    layout();
+  }
+  return 12 + 8 + m_json.size() + (m_binLength > 0 ? 8 + m_binLength : 0);
+}
+
+void GLBWriter::write(std::ostream& out)
+{
+  const size_t length = byteLength();
+
+  writeUint32(out, kMagic);
+  writeUint32(out, kVersion);
+  writeUint32(out, (unsigned int)length);
+
+  writeUint32(out, (unsigned int)m_json.size());
+  writeUint32(out, kChunkJSON);
+  out.write(m_json.data(), m_json.size());
+
+  if (m_binLength == 0) {
+    return;
+  }
+  writeUint32(out, (unsigned int)m_binLength);
+  writeUint32(out, kChunkBIN);
+  for (size_t m = 0; m < m_meshes.size(); m++) {
+    const Mesh& mesh = *m_meshes[m];
+    if (mesh.vertices.empty() || mesh.triangles.empty()) {
+      continue;
+    }
+    // the floats are written in the byte order of the platform ( little endian for node ),
+    // the triangle indices are positive : their Int32 bytes are valid UInt32
+    out.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Coord3f));
+    out.write(reinterpret_cast<const char*>(mesh.normals.data()), mesh.normals.size() * sizeof(Coord3f));
+    out.write(reinterpret_cast<const char*>(mesh.triangles.data()), mesh.triangles.size() * sizeof(Triangle3i));
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "Mesh.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+//
+// binary glTF 2.0 ( GLB ) serialization of meshes and of their instances.
+// the vertices, normals and triangles of the meshes are written as they are
+// in the native buffers : the binary chunk is streamed without intermediate copy.
+//
+// each mesh gives a glTF mesh whose primitives share the position and normal
+// accessors : one primitive for all the triangles, or one per face ( the face
+// hash code is then stored in the extras of the primitive ).
+// each instance gives a node with its 4x4 column major matrix.
+//
+// Note: the writer doesn't use V8 and can be used from a worker thread.
+//
+class GLBWriter {
+public:
+  explicit GLBWriter(bool facePrimitives = false);
+
+  // the mesh must stay alive and unchanged until the file has been written,
+  // returns the index of the mesh
+  int addMesh(const Mesh* mesh);
+
+  // an occurrence of a mesh ( matrix is 16 doubles, NULL for identity )
+  void addInstance(int mesh, const double* matrix);
+
+  // size in bytes of the whole GLB file
+  size_t byteLength();
+
+  void write(std::ostream& out);
+
+private:
+  void layout();
+
+  bool m_facePrimitives;
+  std::vector<const Mesh*> m_meshes;
+  std::vector<int> m_instanceMesh;
+  std::vector<double> m_matrices;   // 16 per instance
+  std::vector<bool> m_hasMatrix;
+
+  bool m_laidOut;
+  std::string m_json;               // padded with spaces to a multiple of 4 bytes
+  size_t m_binLength;
+};
@@ -6,24 +6,33 @@
 #include <map>
 #include <limits>
 #include <assert.h>
+#include <uv.h>
 
 #include "Util.h"
+#include "MeshExtractor.h"
+#include "MeshOptimizer.h"
+#include "MeshEncoder.h"
 
 // old handle in V8 : see http://create.tpsitulsa.com/wiki/V8/Handles
 
 Mesh::Mesh()
+  : m_pristine(true)
+  , m_separateFaceVertices(true)
+  , m_exposed(false)
+  , m_externalMemory(0)
 {
 }
 
+Mesh::~Mesh()
+{
+  if (m_externalMemory > 0) {
+    Nan::AdjustExternalMemory(-(int)m_externalMemory);
+  }
+}
+
 NAN_METHOD(Mesh::New)
 {
   Mesh* obj = new Mesh();
-
-  info.This()->Set(Nan::New("vertices").ToLocalChecked(),   Nan::New<v8::Object>());
-  info.This()->Set(Nan::New("normals").ToLocalChecked(),    Nan::New<v8::Object>());
-  info.This()->Set(Nan::New("edgeindices").ToLocalChecked(),Nan::New<v8::Object>());
-  info.This()->Set(Nan::New("triangles").ToLocalChecked(),  Nan::New<v8::Object>());
-
   obj->Wrap(info.This());
   info.GetReturnValue().Set(info.This());
 }
@@ -48,18 +57,53 @@ void Mesh::Init(v8::Handle<v8::Object> target)
 
   EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numTriangles);
   EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numEdges);
+  EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numFaces);
   EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numVertices);
   EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numNormals);
+  EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numUVNormals);
+  EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numProjectedNormals);
+  EXPOSE_READ_ONLY_PROPERTY_DOUBLE(Mesh,uvNormalsTime);
+  EXPOSE_READ_ONLY_PROPERTY_DOUBLE(Mesh,projectedNormalsTime);
+  EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numWeldedVertices);
+  EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numReusedFaces);
+  EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numCachedFaces);
+  EXPOSE_READ_ONLY_PROPERTY_INTEGER(Mesh,numDecimatedTriangles);
+  EXPOSE_READ_ONLY_PROPERTY_DOUBLE(Mesh,acmr);
+
+  // typed arrays are created on first access ( see Mesh::_array )
+  EXPOSE_READ_ONLY_PROPERTY(_array,vertices);
+  EXPOSE_READ_ONLY_PROPERTY(_array,normals);
+  EXPOSE_READ_ONLY_PROPERTY(_array,triangles);
+  EXPOSE_READ_ONLY_PROPERTY(_array,edgeindices);
+  EXPOSE_READ_ONLY_PROPERTY(_array,faceranges);
+  EXPOSE_READ_ONLY_PROPERTY(_array,encoded);
+  EXPOSE_READ_ONLY_PROPERTY(_encoding,encoding);
 
   // other Mesh prototype members are defined in the mesh.js script
   target->Set(Nan::New("Mesh").ToLocalChecked(), tpl->GetFunction());
 
 }
 
+// normalized ( and optionally reversed ) normal
+static inline Coord3f toCoord3f(gp_Vec normal, bool reversed)
+{
+  if (normal.SquareMagnitude() > 1.0e-10)
+    normal.Normalize();
+  if (reversed)
+    normal.Reverse();
+
+  Coord3f norm;
+  norm.x = (float)normal.X();
+  norm.y = (float)normal.Y();
+  norm.z = (float)normal.Z();
+  return norm;
+}
+
 int Mesh::extractFaceMesh(const TopoDS_Face& face, bool qualityNormals)
 {
 
   size_t vsize = this->vertices.size();
+  size_t tsize = this->triangles.size();
   std::vector<gp_Vec> normals;
   bool reversed = false;
   Coord3f vert;
@@ -71,6 +115,9 @@ int Mesh::extractFaceMesh(const TopoDS_Face& face, bool qualityNormals)
     if(face.IsNull()) {
       StdFail_NotDone::Raise("Face is Null");
     }
+    if (m_exposed) {
+      StdFail_NotDone::Raise("Mesh buffers are already shared with javascript");
+    }
 
     TopLoc_Location loc;
     occHandle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
@@ -109,9 +156,9 @@ int Mesh::extractFaceMesh(const TopoDS_Face& face, bool qualityNormals)
       norm.z = 0.f;
       this->normals.push_back(norm);
 
-      if (!qualityNormals) {
-        normals.push_back(gp_Vec(0.0,0.0,0.0));
-      }
+      // triangle normals are accumulated in all modes: they are also
+      // the fallback when the surface normal is not defined
+      normals.push_back(gp_Vec(0.0,0.0,0.0));
     }
 
     if (face.Orientation() == TopAbs_REVERSED)
@@ -159,176 +206,587 @@ int Mesh::extractFaceMesh(const TopoDS_Face& face, bool qualityNormals)
       tri.k = (int)vsize + n3 - 1;
       this->triangles.push_back(tri);
 
-      if (!qualityNormals) {
-        normals[n1 - 1] = normals[n1 - 1] - normal;
-        normals[n2 - 1] = normals[n2 - 1] - normal;
-        normals[n3 - 1] = normals[n3 - 1] - normal;
-      }
+      normals[n1 - 1] = normals[n1 - 1] - normal;
+      normals[n2 - 1] = normals[n2 - 1] - normal;
+      normals[n3 - 1] = normals[n3 - 1] - normal;
     }
 
-    if (qualityNormals) {
+    if (qualityNormals && triangulation->HasUVNodes()) {
 
+      // fast path : BRepMesh keeps the (u,v) parameters of each node,
+      // the normal is evaluated directly on the untransformed surface
+      uint64_t start = uv_hrtime();
+
+      TopLoc_Location surfaceLoc;
+      Handle_Geom_Surface surface = BRep_Tool::Surface(face, surfaceLoc);
+      const gp_Trsf surfaceTrsf = surfaceLoc;
+      const bool transformed = surfaceLoc.IsIdentity() ? false : true;
+
+      const TColgp_Array1OfPnt2d& uvarr = triangulation->UVNodes();
+      GeomLProp_SLProps faceprop(surface, 1, gp::Resolution());
+
+      for (int i = 0; i < triangulation->NbNodes(); i++) {
+        const gp_Pnt2d& uv = uvarr(i + 1);
+        faceprop.SetParameters(uv.X(), uv.Y());
+
+        if (faceprop.IsNormalDefined()) {
+          gp_Vec normal = faceprop.Normal();
+          if (transformed) {
+            normal.Transform(surfaceTrsf);
+          }
+          this->normals[vsize + i] = toCoord3f(normal, reversed);
+        } else {
+          // singular point ( apex, pole ... )
+          this->normals[vsize + i] = toCoord3f(normals[i], false);
+        }
+      }
+      m_statistics.nbUVNormals += triangulation->NbNodes();
+      m_statistics.uvNormalsTime += double(uv_hrtime() - start) * 1E-6;
+
+    } else if (qualityNormals) {
+
+      // slow path : the triangulation has no (u,v) nodes, they are
+      // recovered by projecting each node on the surface
+      uint64_t start = uv_hrtime();
 
       Handle_Geom_Surface surface = BRep_Tool::Surface(face);
-      gp_Vec normal;
+      GeomLProp_SLProps faceprop(surface, 1, gp::Resolution());
+
       for (int i = 0; i < triangulation->NbNodes(); i++) {
         vert = this->vertices[vsize + i];
         gp_Pnt vertex(vert.x, vert.y, vert.z);
         GeomAPI_ProjectPointOnSurf SrfProp(vertex, surface);
-        Standard_Real fU, fV;
-        SrfProp.Parameters(1, fU, fV);
-
-        GeomLProp_SLProps faceprop(surface, fU, fV, 2, gp::Resolution());
-        normal = faceprop.Normal();
 
-        if (normal.SquareMagnitude() > 1.0e-10)
-          normal.Normalize();
-
-        if (reversed) {
-          norm.x = (float)-normal.X();
-          norm.y = (float)-normal.Y();
-          norm.z = (float)-normal.Z();
+        bool defined = false;
+        if (SrfProp.NbPoints() > 0) {
+          Standard_Real fU, fV;
+          SrfProp.Parameters(1, fU, fV);
+          faceprop.SetParameters(fU, fV);
+          defined = faceprop.IsNormalDefined() ? true : false;
+        }
+        if (defined) {
+          this->normals[vsize + i] = toCoord3f(faceprop.Normal(), reversed);
         } else {
-          norm.x = (float)normal.X();
-          norm.y = (float)normal.Y();
-          norm.z = (float)normal.Z();
+          this->normals[vsize + i] = toCoord3f(normals[i], false);
         }
-        this->normals[vsize + i] = norm;
       }
+      m_statistics.nbProjectedNormals += triangulation->NbNodes();
+      m_statistics.projectedNormalsTime += double(uv_hrtime() - start) * 1E-6;
+
     } else {
       // Normalize vertex normals
       for (int i = 0; i < triangulation->NbNodes(); i++) {
-        gp_Vec normal = normals[i];
-        if (normal.SquareMagnitude() > 1.0e-10)
-          normal.Normalize();
-
-        norm.x = (float)normal.X();
-        norm.y = (float)normal.Y();
-        norm.z = (float)normal.Z();
-        this->normals[vsize + i] = norm;
+        this->normals[vsize + i] = toCoord3f(normals[i], false);
       }
     }
 
 
 
     // extract edge indices from mesh
-    std::set<int> seen;
-    for (unsigned int i = 0; i < this->edgehash.size(); i++)
-      seen.insert(this->edgehash[i]);
+    extractFaceEdges(face, triangulation, loc, vsize);
+
+    MeshFaceRange range;
+    range.hash          = face.HashCode(std::numeric_limits<int>::max());
+    range.firstTriangle = (int)tsize;
+    range.nbTriangles   = (int)(this->triangles.size() - tsize);
+    range.firstVertex   = (int)vsize;
+    range.nbVertices    = triangulation->NbNodes();
+    this->faceranges.push_back(range);
+    this->m_faces.push_back(face);
+    m_faceIndex.clear();
 
-    size_t lastSize = this->edgeindices.size();
-    TopExp_Explorer ex0, ex1;
-    for (ex0.Init(face, TopAbs_WIRE); ex0.More(); ex0.Next()) {
-      const TopoDS_Wire& wire = TopoDS::Wire(ex0.Current());
+  } catch(Standard_Failure&) {
+    Handle_Standard_Failure e = Standard_Failure::Caught();
+    const Standard_CString msg = e->GetMessageString();
+    if (msg != NULL && strlen(msg) > 1) {
+      setErrorMessage(msg);
+    } else {
+      setErrorMessage("Failed to mesh object");
+    }
+    return 0;
+  }
+  return 1;
+}
 
-      for (ex1.Init(wire, TopAbs_EDGE); ex1.More(); ex1.Next()) {
-        const TopoDS_Edge& edge = TopoDS::Edge(ex1.Current());
+// the edges of the face that are not yet in the mesh, vsize is
+// the index of the first node of the triangulation in the mesh
+void Mesh::extractFaceEdges(const TopoDS_Face& face, const occHandle(Poly_Triangulation)& triangulation,
+                            const TopLoc_Location& loc, size_t vsize)
+{
+  size_t lastSize = this->edgeindices.size();
+  TopExp_Explorer ex0, ex1;
+  for (ex0.Init(face, TopAbs_WIRE); ex0.More(); ex0.Next()) {
+    const TopoDS_Wire& wire = TopoDS::Wire(ex0.Current());
 
-        // skip degenerated edge
-        if (BRep_Tool::Degenerated(edge))
-          continue;
+    for (ex1.Init(wire, TopAbs_EDGE); ex1.More(); ex1.Next()) {
+      const TopoDS_Edge& edge = TopoDS::Edge(ex1.Current());
 
-        // skip edge if it is a seam
-        if (BRep_Tool::IsClosed(edge, face))
-          continue;
+      // skip degenerated edge
+      if (BRep_Tool::Degenerated(edge))
+        continue;
 
-        int hash = edge.HashCode(std::numeric_limits<int>::max());
-        if (seen.count(hash) == 0) {
-          occHandle(Poly_PolygonOnTriangulation) edgepoly = BRep_Tool::PolygonOnTriangulation(edge, triangulation, loc);
-          if (edgepoly.IsNull()) {
-            continue;
-          }
-          seen.insert(hash);
-          this->edgehash.push_back(hash);
-          this->edgeranges.push_back((int)this->edgeindices.size());
-
-          const TColStd_Array1OfInteger& edgeind = edgepoly->Nodes();
-          for (int i=edgeind.Lower(); i <= edgeind.Upper(); i++) {
-            const unsigned int idx = (unsigned int)edgeind(i);
-            this->edgeindices.push_back((int)(vsize + idx - 1));
-          }
+      // skip edge if it is a seam
+      if (BRep_Tool::IsClosed(edge, face))
+        continue;
 
-          this->edgeranges.push_back((int)(this->edgeindices.size() - lastSize));
-          lastSize = this->edgeindices.size();
+      int hash = edge.HashCode(std::numeric_limits<int>::max());
+      if (m_edgeHashSet.count(hash) == 0) {
+        occHandle(Poly_PolygonOnTriangulation) edgepoly = BRep_Tool::PolygonOnTriangulation(edge, triangulation, loc);
+        if (edgepoly.IsNull()) {
+          continue;
+        }
+        m_edgeHashSet.insert(hash);
+        this->edgehash.push_back(hash);
+        this->edgeranges.push_back((int)this->edgeindices.size());
+
+        const TColStd_Array1OfInteger& edgeind = edgepoly->Nodes();
+        for (int i=edgeind.Lower(); i <= edgeind.Upper(); i++) {
+          const unsigned int idx = (unsigned int)edgeind(i);
+          this->edgeindices.push_back((int)(vsize + idx - 1));
         }
+
+        this->edgeranges.push_back((int)(this->edgeindices.size() - lastSize));
+        lastSize = this->edgeindices.size();
       }
     }
+  }
+}
 
-  } catch(Standard_Failure&) {
-    Handle_Standard_Failure e = Standard_Failure::Caught();
-    const Standard_CString msg = e->GetMessageString();
-    if (msg != NULL && strlen(msg) > 1) {
-      setErrorMessage(msg);
-    } else {
-      setErrorMessage("Failed to mesh object");
-    }
+int Mesh::findIdenticalFace(const TopoDS_Face& face)
+{
+  if (!m_pristine) {
+    return -1;
+  }
+  const int index = findFaceRange(face);
+  if (index < 0 || !m_faces[index].IsEqual(face)) {
+    return -1;
+  }
+  return index;
+}
+
+int Mesh::appendFaceMesh(const Mesh& source, int index)
+{
+  assert(!m_exposed);
+  assert(source.m_pristine);
+
+  const TopoDS_Face& face = source.m_faces[index];
+  const MeshFaceRange& sourceRange = source.faceranges[index];
+
+  TopLoc_Location loc;
+  occHandle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
+  if (triangulation.IsNull() || triangulation->NbNodes() != sourceRange.nbVertices) {
+    // the face has been meshed again since the source was extracted
     return 0;
   }
-  optimize();
-  updateJavaScriptArray();
+
+  const size_t vsize = vertices.size();
+  const int offset = (int)vsize - sourceRange.firstVertex;
+
+  MeshFaceRange range = sourceRange;
+  range.firstTriangle = (int)triangles.size();
+  range.firstVertex   = (int)vsize;
+
+  vertices.insert(vertices.end(), source.vertices.begin() + sourceRange.firstVertex,
+                  source.vertices.begin() + sourceRange.firstVertex + sourceRange.nbVertices);
+  normals.insert(normals.end(), source.normals.begin() + sourceRange.firstVertex,
+                 source.normals.begin() + sourceRange.firstVertex + sourceRange.nbVertices);
+  for (int t = sourceRange.firstTriangle; t < sourceRange.firstTriangle + sourceRange.nbTriangles; t++) {
+    Triangle3i tri = source.triangles[t];
+    tri.i += offset;
+    tri.j += offset;
+    tri.k += offset;
+    triangles.push_back(tri);
+  }
+
+  // the edges are owned by the first face that has them in this mesh
+  extractFaceEdges(face, triangulation, loc, vsize);
+
+  faceranges.push_back(range);
+  m_faces.push_back(face);
+  m_faceIndex.clear();
+  m_statistics.nbReusedFaces++;
   return 1;
 }
 
+void Mesh::relabel(const std::vector<TopoDS_Face>& faces, const std::unordered_map<int, int>& edgeHashes)
+{
+  assert(faces.size() == faceranges.size());
+
+  for (size_t f = 0; f < faceranges.size(); f++) {
+    faceranges[f].hash = faces[f].HashCode(std::numeric_limits<int>::max());
+  }
+  m_faces = faces;
+  m_faceIndex.clear();
+
+  m_edgeHashSet.clear();
+  for (size_t e = 0; e < edgehash.size(); e++) {
+    std::unordered_map<int, int>::const_iterator it = edgeHashes.find(edgehash[e]);
+    if (it != edgeHashes.end()) {
+      edgehash[e] = it->second;
+    }
+    m_edgeHashSet.insert(edgehash[e]);
+  }
+
+  // the triangulations of the faces are not the ones of the mesh
+  m_pristine = false;
+}
 
-template<class T>
-void UpdateExternalArray(v8::Handle<v8::Object>& pThis, const char* name, const T* data, size_t _length)
+void Mesh::concatenate(const std::vector<Mesh*>& parts)
 {
-  v8::Local<v8::Object> arr = _makeTypedArray(data, (int)_length);
-  pThis->Set(Nan::New(name).ToLocalChecked(), arr);
+  assert(!m_exposed);
+
+  // the prefix sums of the part sizes give the offset of each part
+  std::vector<size_t> vertexOffsets(parts.size());
+  std::vector<size_t> triangleOffsets(parts.size());
+  size_t nbVertices = vertices.size();
+  size_t nbTriangles = triangles.size();
+  size_t nbEdgeIndices = edgeindices.size();
+  for (size_t i = 0; i < parts.size(); i++) {
+    vertexOffsets[i] = nbVertices;
+    triangleOffsets[i] = nbTriangles;
+    nbVertices    += parts[i]->vertices.size();
+    nbTriangles   += parts[i]->triangles.size();
+    nbEdgeIndices += parts[i]->edgeindices.size();
+  }
+  vertices.reserve(nbVertices);
+  normals.reserve(nbVertices);
+  triangles.reserve(nbTriangles);
+  edgeindices.reserve(nbEdgeIndices);
+
+  for (size_t i = 0; i < parts.size(); i++) {
+    const Mesh& part = *parts[i];
+    const int offset = (int)vertexOffsets[i];
+    assert(vertices.size() == vertexOffsets[i]);
+
+    m_statistics.add(part.m_statistics);
+
+    vertices.insert(vertices.end(), part.vertices.begin(), part.vertices.end());
+    normals.insert(normals.end(), part.normals.begin(), part.normals.end());
+
+    for (size_t t = 0; t < part.triangles.size(); t++) {
+      Triangle3i tri = part.triangles[t];
+      tri.i += offset;
+      tri.j += offset;
+      tri.k += offset;
+      triangles.push_back(tri);
+    }
+
+    for (size_t f = 0; f < part.faceranges.size(); f++) {
+      MeshFaceRange range = part.faceranges[f];
+      range.firstTriangle += (int)triangleOffsets[i];
+      range.firstVertex   += offset;
+      faceranges.push_back(range);
+    }
+    m_faces.insert(m_faces.end(), part.m_faces.begin(), part.m_faces.end());
+    m_pristine = m_pristine && part.m_pristine;
+    m_separateFaceVertices = m_separateFaceVertices && part.m_separateFaceVertices;
+
+    // edges shared by several faces are kept only once ( first face wins )
+    for (size_t e = 0; e < part.edgehash.size(); e++) {
+      const int hash = part.edgehash[e];
+      if (!m_edgeHashSet.insert(hash).second) {
+        continue;
+      }
+      const int start = part.edgeranges[2 * e];
+      const int count = part.edgeranges[2 * e + 1];
+
+      edgehash.push_back(hash);
+      edgeranges.push_back((int)edgeindices.size());
+      for (int j = start; j < start + count; j++) {
+        edgeindices.push_back(part.edgeindices[j] + offset);
+      }
+      edgeranges.push_back(count);
+    }
+  }
+  m_faceIndex.clear();
+}
+
+void Mesh::swap(Mesh& other)
+{
+  assert(!m_exposed && !other.m_exposed);
+  normals.swap(other.normals);
+  vertices.swap(other.vertices);
+  triangles.swap(other.triangles);
+  edgeindices.swap(other.edgeindices);
+  edgeranges.swap(other.edgeranges);
+  edgehash.swap(other.edgehash);
+  m_edgeHashSet.swap(other.m_edgeHashSet);
+  faceranges.swap(other.faceranges);
+  m_faces.swap(other.m_faces);
+  std::swap(m_pristine, other.m_pristine);
+  std::swap(m_separateFaceVertices, other.m_separateFaceVertices);
+  m_faceIndex.swap(other.m_faceIndex);
+  encoded.swap(other.encoded);
+  std::swap(encoding, other.encoding);
+  std::swap(m_statistics, other.m_statistics);
+}
+
+void Mesh::takeEdgeHashes(Mesh& previous)
+{
+  m_edgeHashSet.swap(previous.m_edgeHashSet);
 }
 
-void Mesh::updateJavaScriptArray()
+size_t Mesh::byteSize() const
 {
+  return sizeof(Mesh)
+    + vertices.capacity() * sizeof(vertices[0])
+    + normals.capacity() * sizeof(normals[0])
+    + triangles.capacity() * sizeof(triangles[0])
+    + edgeindices.capacity() * sizeof(edgeindices[0])
+    + edgeranges.capacity() * sizeof(edgeranges[0])
+    + edgehash.capacity() * sizeof(edgehash[0])
+    + m_edgeHashSet.size() * (sizeof(int) + 2 * sizeof(void*))
+    + faceranges.capacity() * sizeof(faceranges[0])
+    + m_faces.capacity() * sizeof(m_faces[0])
+    + encoded.capacity();
+}
+
+
+//
+// the typed arrays are views on the native buffers of the mesh ( no copy ).
+// the ArrayBuffer holds a reference to the mesh object so that the
+// native storage lives as long as one of its buffers is reachable.
+// Once a buffer has been exposed, the native vectors must not be modified.
+//
+v8::Local<v8::Object> Mesh::createJavaScriptArray(const char* name)
+{
+  assert(sizeof(vertices[0])==sizeof(float)*3);
   assert(sizeof(triangles[0])==sizeof(int)*3);
-  v8::Local<v8::Object> pThis = NanObjectWrapHandle(this);
-  UpdateExternalArray(pThis, "vertices"    ,&vertices.data()[0].x   ,vertices.size()*3);
-  UpdateExternalArray(pThis, "normals"     ,&normals.data()[0].x    ,normals.size()*3);
-  UpdateExternalArray(pThis, "triangles"   ,&triangles.data()[0].i  ,triangles.size()*3);
-  UpdateExternalArray(pThis, "edgeindices" ,&edgeindices.data()[0]  ,edgeindices.size());
+  assert(sizeof(faceranges[0])==sizeof(int)*5);
+
+  v8::Local<v8::Object> arr;
+  v8::Local<v8::Object> buffer;
+  size_t byteLength = 0;
+
+  if (!strcmp(name, "vertices")) {
+    arr = makeExternalTypedArray(A_Float32, vertices.data(), vertices.size()*3);
+    byteLength = vertices.size()*sizeof(vertices[0]);
+  } else if (!strcmp(name, "normals")) {
+    arr = makeExternalTypedArray(A_Float32, normals.data(), normals.size()*3);
+    byteLength = normals.size()*sizeof(normals[0]);
+  } else if (!strcmp(name, "triangles")) {
+    arr = makeExternalTypedArray(A_Int32, triangles.data(), triangles.size()*3);
+    byteLength = triangles.size()*sizeof(triangles[0]);
+  } else if (!strcmp(name, "edgeindices")) {
+    arr = makeExternalTypedArray(A_UInt32, edgeindices.data(), edgeindices.size());
+    byteLength = edgeindices.size()*sizeof(edgeindices[0]);
+  } else if (!strcmp(name, "faceranges")) {
+    arr = makeExternalTypedArray(A_Int32, faceranges.data(), faceranges.size()*5);
+    byteLength = faceranges.size()*sizeof(faceranges[0]);
+  } else if (!strcmp(name, "encoded") && !encoded.empty()) {
+    // the encoded mesh is exposed as a plain ArrayBuffer
+    arr = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), encoded.data(), encoded.size());
+    byteLength = encoded.size();
+  }
+  if (arr.IsEmpty()) {
+    return arr;
+  }
+
+  buffer = arr->IsArrayBuffer() ? arr : v8::Local<v8::Object>(arr.As<v8::TypedArray>()->Buffer());
+  buffer->ForceSet(Nan::New("_owner").ToLocalChecked(), NanObjectWrapHandle(this),
+                   (v8::PropertyAttribute)(v8::DontEnum|v8::DontDelete|v8::ReadOnly));
+
+  m_exposed = true;
+  m_externalMemory += byteLength;
+  Nan::AdjustExternalMemory((int)byteLength);
+  return arr;
 }
 
+//
+// the javascript typed arrays are only built once, the first time
+// they are read. The array is then stored as a read-only property
+// of the instance that shadows this prototype accessor.
+//
+NAN_PROPERTY_GETTER(Mesh::_array)
+{
+  if (info.This().IsEmpty()) {
+    return;
+  }
+  if (info.This()->InternalFieldCount() == 0 ) {
+    return;
+  }
+  Mesh* pThis = ObjectWrap::Unwrap<Mesh>(info.This());
 
-float square(float b)
+  Nan::Utf8String name(property);
+  v8::Local<v8::Object> arr = pThis->createJavaScriptArray(*name);
+  if (arr.IsEmpty()) {
+    return;
+  }
+  info.This()->ForceSet(property, arr, (v8::PropertyAttribute)(v8::DontDelete|v8::ReadOnly));
+  info.GetReturnValue().Set(arr);
+}
+
+static v8::Local<v8::Array> makeVector3(const double* v)
 {
-  return b*b;
+  v8::Local<v8::Array> arr = Nan::New<v8::Array>(3);
+  for (uint32_t i = 0; i < 3; i++) {
+    arr->Set(i, Nan::New<v8::Number>(v[i]));
+  }
+  return arr;
 }
 
-float distance2( const Coord3f& a,const Coord3f& b)
+NAN_PROPERTY_GETTER(Mesh::_encoding)
 {
-  return square(a.x -b.x) + square(a.y -b.y)    + square(a.y -b.y);
+  if (info.This().IsEmpty()) {
+    return;
+  }
+  if (info.This()->InternalFieldCount() == 0 ) {
+    return;
+  }
+  Mesh* pThis = ObjectWrap::Unwrap<Mesh>(info.This());
+  if (pThis->encoded.empty()) {
+    return;
+  }
+  const MeshEncoding& enc = pThis->encoding;
+
+  v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+  obj->Set(Nan::New("vertexCount").ToLocalChecked(), Nan::New<v8::Number>((double)enc.vertexCount));
+  obj->Set(Nan::New("vertexStride").ToLocalChecked(), Nan::New<v8::Number>((double)enc.vertexStride));
+  obj->Set(Nan::New("positionType").ToLocalChecked(), Nan::New("Uint16").ToLocalChecked());
+  obj->Set(Nan::New("positionOffset").ToLocalChecked(), makeVector3(enc.positionOffset));
+  obj->Set(Nan::New("positionScale").ToLocalChecked(), makeVector3(enc.positionScale));
+  obj->Set(Nan::New("normalType").ToLocalChecked(), Nan::New("Int8").ToLocalChecked());
+  obj->Set(Nan::New("normalByteOffset").ToLocalChecked(), Nan::New<v8::Number>(6));
+  obj->Set(Nan::New("normalEncoding").ToLocalChecked(), Nan::New("octahedral").ToLocalChecked());
+  obj->Set(Nan::New("indexType").ToLocalChecked(), Nan::New(enc.uint16Indices ? "Uint16" : "Uint32").ToLocalChecked());
+  obj->Set(Nan::New("indexByteOffset").ToLocalChecked(), Nan::New<v8::Number>((double)enc.indexByteOffset));
+  obj->Set(Nan::New("indexCount").ToLocalChecked(), Nan::New<v8::Number>((double)enc.indexCount));
+  obj->Set(Nan::New("edgeIndexByteOffset").ToLocalChecked(), Nan::New<v8::Number>((double)enc.edgeIndexByteOffset));
+  obj->Set(Nan::New("edgeIndexCount").ToLocalChecked(), Nan::New<v8::Number>((double)enc.edgeIndexCount));
+
+  info.This()->ForceSet(property, obj, (v8::PropertyAttribute)(v8::DontDelete|v8::ReadOnly));
+  info.GetReturnValue().Set(obj);
 }
-int findPt(const std::vector<Coord3f>& arrayPts, const Coord3f pt,double tolerance)
+
+
+void Mesh::optimize(const MeshParameters& params)
 {
+  if (params.weld || params.vertexCache || params.decimate) {
+    // the faces no longer map one to one to their triangulation
+    m_pristine = false;
+  }
+  if (params.decimate) {
+    // before welding : the faces are still separate patches with open borders
+    size_t target = params.targetTriangles;
+    if (params.targetRatio > 0 && params.targetRatio < 1) {
+      const size_t ratioTarget = (size_t)(params.targetRatio * triangles.size());
+      target = std::max(target, ratioTarget);
+    }
+    MeshOptimizer::decimate(*this, target, params.maxError);
+  }
+  if (params.weld) {
+    MeshOptimizer::weldVertices(*this, params.weldTolerance, params.creaseAngle);
+  }
+  if (params.vertexCache) {
+    MeshOptimizer::optimizeVertexCache(*this, params.overdraw);
+    MeshOptimizer::optimizeVertexFetch(*this);
+  }
+  updateFaceVertexRanges();
+  m_faceIndex.clear();
 
-  double tolerance2 =tolerance*tolerance;
-  int i=0;
-  for (std::vector<Coord3f>::const_iterator it=arrayPts.begin(); it!=arrayPts.end(); it++) {
-    const Coord3f& point = (*it);
-    if ( distance2(point,pt) < tolerance2)  {
-      return i;
+  if (params.encoding == MeshParameters::QUANTIZED) {
+    MeshEncoder::encodeQuantized(*this);
+  }
+}
+
+double Mesh::acmr()
+{
+  return MeshOptimizer::computeACMR(*this);
+}
+
+void Mesh::updateFaceVertexRanges()
+{
+  // welding and reordering move the vertices of the faces
+  for (size_t f = 0; f < faceranges.size(); f++) {
+    MeshFaceRange& range = faceranges[f];
+    if (range.nbTriangles == 0) {
+      continue;
+    }
+    int vmin = std::numeric_limits<int>::max();
+    int vmax = -1;
+    for (int t = range.firstTriangle; t < range.firstTriangle + range.nbTriangles; t++) {
+      const Triangle3i& tri = triangles[t];
+      vmin = std::min(vmin, std::min(tri.i, std::min(tri.j, tri.k)));
+      vmax = std::max(vmax, std::max(tri.i, std::max(tri.j, tri.k)));
     }
-    i++;
+    range.firstVertex = vmin;
+    range.nbVertices = vmax - vmin + 1;
+  }
+
+  // welding shares vertices between faces : the span of a face is then only
+  // the smallest interval that holds its vertices. When the spans don't
+  // overlap, each span only holds the vertices of its face.
+  std::vector<std::pair<int, int> > spans;
+  spans.reserve(faceranges.size());
+  for (size_t f = 0; f < faceranges.size(); f++) {
+    if (faceranges[f].nbTriangles > 0) {
+      spans.push_back(std::make_pair(faceranges[f].firstVertex, faceranges[f].firstVertex + faceranges[f].nbVertices));
+    }
+  }
+  std::sort(spans.begin(), spans.end());
+  m_separateFaceVertices = true;
+  for (size_t i = 1; i < spans.size() && m_separateFaceVertices; i++) {
+    m_separateFaceVertices = spans[i - 1].second <= spans[i].first;
   }
-  return -1;
 }
-void Mesh::optimize()
+
+int Mesh::findFaceRange(const TopoDS_Face& face)
 {
-#if 0
-  double tolerance =1E-6;
-
-  std::map<int,int> indexOldNewMap;
-  std::vector<Coord3f> newPoints;
-  newPoints.reserve(vertices.size());
-  int i=0;
-  for (std::vector<Coord3f>::const_iterator it=vertices.begin(); it!=vertices.end(); it++) {
-    int pos = findPt(newPoints,*it,tolerance);
-    if (pos == -1) {
-      newPoints.push_back(*it);
-      indexOldNewMap[i] =   newPoints.size()-1;
+  if (m_faceIndex.empty()) {
+    for (size_t f = 0; f < faceranges.size(); f++) {
+      m_faceIndex.insert(std::make_pair(faceranges[f].hash, (int)f));
+    }
+  }
+  // the hash codes may collide : the first range of the same face wins
+  const int hash = face.HashCode(std::numeric_limits<int>::max());
+  int index = -1;
+  typedef std::unordered_multimap<int, int>::const_iterator Iterator;
+  std::pair<Iterator, Iterator> candidates = m_faceIndex.equal_range(hash);
+  for (Iterator it = candidates.first; it != candidates.second; ++it) {
+    const int f = it->second;
+    if (f < (int)m_faces.size() && m_faces[f].IsSame(face) && (index < 0 || f < index)) {
+      index = f;
     }
-    i++;
   }
-#endif
+  return index;
+}
 
+//
+// the view shares the ArrayBuffers of the mesh : the triangle indices
+// refer to the vertices of the whole mesh, subtract vertexOffset to
+// index the vertices and normals of the view.
+//
+v8::Local<v8::Value> Mesh::createFaceView(v8::Local<v8::Object> meshObject, const TopoDS_Face& face)
+{
+  Nan::EscapableHandleScope scope;
 
+  Mesh* pThis = ObjectWrap::Unwrap<Mesh>(meshObject);
+  const int index = pThis->findFaceRange(face);
+  if (index < 0 || !pThis->m_separateFaceVertices) {
+    return scope.Escape(Nan::Undefined());
+  }
+  const MeshFaceRange range = pThis->faceranges[index];
+
+  // reading the properties builds the typed arrays of the mesh if needed
+  v8::Local<v8::TypedArray> vertices = meshObject->Get(Nan::New("vertices").ToLocalChecked()).As<v8::TypedArray>();
+  v8::Local<v8::TypedArray> normals = meshObject->Get(Nan::New("normals").ToLocalChecked()).As<v8::TypedArray>();
+  v8::Local<v8::TypedArray> triangles = meshObject->Get(Nan::New("triangles").ToLocalChecked()).As<v8::TypedArray>();
+
+  const size_t vertexStride = sizeof(Coord3f);
+  const size_t triangleStride = sizeof(Triangle3i);
+
+  v8::Local<v8::Object> view = Nan::New<v8::Object>();
+  view->Set(Nan::New("vertices").ToLocalChecked(),
+            v8::Float32Array::New(vertices->Buffer(), range.firstVertex * vertexStride, range.nbVertices * 3));
+  view->Set(Nan::New("normals").ToLocalChecked(),
+            v8::Float32Array::New(normals->Buffer(), range.firstVertex * vertexStride, range.nbVertices * 3));
+  view->Set(Nan::New("triangles").ToLocalChecked(),
+            v8::Int32Array::New(triangles->Buffer(), range.firstTriangle * triangleStride, range.nbTriangles * 3));
+  view->Set(Nan::New("numTriangles").ToLocalChecked(), Nan::New<v8::Integer>(range.nbTriangles));
+  view->Set(Nan::New("numVertices").ToLocalChecked(), Nan::New<v8::Integer>(range.nbVertices));
+  view->Set(Nan::New("triangleOffset").ToLocalChecked(), Nan::New<v8::Integer>(range.firstTriangle));
+  view->Set(Nan::New("vertexOffset").ToLocalChecked(), Nan::New<v8::Integer>(range.firstVertex));
+  view->Set(Nan::New("mesh").ToLocalChecked(), meshObject);
+
+  return scope.Escape(view);
 }
@@ -2,6 +2,8 @@
 #include "NodeV8.h"
 #include "GeometryBuilder.h"
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
 struct Coord3f {
     float x;
@@ -13,14 +15,121 @@ struct Triangle3i {
     int j;
     int k;
 };
+struct MeshParameters;
+// triangles and vertices of one face in the buffers of the mesh
+// ( exposed to javascript as 5 integers per face in mesh.faceranges ).
+// once the vertices have been welded, the vertex span of a face may also
+// hold vertices of other faces.
+struct MeshFaceRange {
+    int hash;           // hash code of the face
+    int firstTriangle;
+    int nbTriangles;
+    int firstVertex;    // the vertices used by the triangles of the face
+    int nbVertices;     // are in [firstVertex, firstVertex + nbVertices)
+};
+// counters filled during the extraction of the face meshes
+struct MeshStatistics {
+    MeshStatistics()
+      : nbUVNormals(0), nbProjectedNormals(0), uvNormalsTime(0), projectedNormalsTime(0)
+      , nbWeldedVertices(0), nbReusedFaces(0), nbCachedFaces(0), nbDecimatedTriangles(0)
+    {}
+    void add(const MeshStatistics& other) {
+        nbUVNormals          += other.nbUVNormals;
+        nbProjectedNormals   += other.nbProjectedNormals;
+        uvNormalsTime        += other.uvNormalsTime;
+        projectedNormalsTime += other.projectedNormalsTime;
+        nbWeldedVertices     += other.nbWeldedVertices;
+        nbReusedFaces        += other.nbReusedFaces;
+        nbCachedFaces        += other.nbCachedFaces;
+        nbDecimatedTriangles += other.nbDecimatedTriangles;
+    }
+    int    nbUVNormals;          // normals evaluated from the (u,v) nodes of the triangulation
+    int    nbProjectedNormals;   // normals evaluated after projecting the node on the surface
+    double uvNormalsTime;        // in milliseconds
+    double projectedNormalsTime; // in milliseconds
+    int    nbWeldedVertices;     // vertices removed by MeshOptimizer::weldVertices
+    int    nbReusedFaces;        // faces copied from another mesh by appendFaceMesh
+    int    nbCachedFaces;        // faces found in the FaceMeshCache
+    int    nbDecimatedTriangles; // triangles removed by MeshOptimizer::decimate
+};
+
+// decoding parameters of the compact encoding of a mesh ( see MeshEncoder )
+struct MeshEncoding {
+    MeshEncoding()
+      : vertexCount(0), vertexStride(0), uint16Indices(false)
+      , indexByteOffset(0), indexCount(0), edgeIndexByteOffset(0), edgeIndexCount(0)
+    {
+        for (int i = 0; i < 3; i++) {
+            positionOffset[i] = 0;
+            positionScale[i] = 0;
+        }
+    }
+    size_t vertexCount;
+    size_t vertexStride;      // in bytes
+    double positionOffset[3];
+    double positionScale[3];
+    bool   uint16Indices;
+    size_t indexByteOffset;
+    size_t indexCount;
+    size_t edgeIndexByteOffset;
+    size_t edgeIndexCount;
+};
+
 class Mesh : public  node::ObjectWrap  {
 public:
     Mesh();
+    virtual ~Mesh();
+    // note: extractFaceMesh doesn't access V8 and can be called from a worker thread
     int extractFaceMesh(const TopoDS_Face& face, bool qualityNormals);
-    void optimize();
+    // optimization and encoding passes selected by the parameters ( welding ... )
+    void optimize(const MeshParameters& params);
+
+    // index of the range of a face that has been extracted as is, with the
+    // same orientation ( -1 if the face is not found or the mesh has been optimized )
+    int findIdenticalFace(const TopoDS_Face& face);
+
+    // append the mesh of the face index of another mesh, as if it had been
+    // extracted with extractFaceMesh ( returns 0 if the face has been meshed again )
+    int appendFaceMesh(const Mesh& source, int index);
+
+    // give the faces and edges of the mesh the identity of the corresponding
+    // faces and edges of another shape ( used when a copy of a shape has been meshed ).
+    // faces[i] replaces the face of range i, edgeHashes maps the old edge hashes to the new ones
+    void relabel(const std::vector<TopoDS_Face>& faces, const std::unordered_map<int, int>& edgeHashes);
+
+    // append the meshes of several faces, in order, as if they had
+    // been extracted one after the other with extractFaceMesh
+    void concatenate(const std::vector<Mesh*>& parts);
+
+    // exchange the native buffers with another mesh
+    void swap(Mesh& other);
+
+    // take over the edges already extracted by the previous chunk of the
+    // same shape, so that they are not extracted again ( see meshShapeInChunks )
+    void takeEdgeHashes(Mesh& previous);
+
+    // approximate size of the native buffers
+    size_t byteSize() const;
+
+    MeshStatistics& statistics() {
+        return m_statistics;
+    }
 
     static NAN_METHOD(New);
 
+    // vertices, normals, triangles and edgeindices typed arrays
+    static NAN_PROPERTY_GETTER(_array);
+    // decoding parameters of the encoded buffer ( undefined if not encoded )
+    static NAN_PROPERTY_GETTER(_encoding);
+
+    // index of the range of a face in faceranges, -1 if the face is not in the mesh
+    int findFaceRange(const TopoDS_Face& face);
+
+    // javascript object with typed arrays that are views on the buffers of the
+    // mesh for one of its faces ( undefined if the face is not found, or if the
+    // vertices of the faces are no longer separate, see updateFaceVertexRanges )
+    static v8::Local<v8::Value> createFaceView(v8::Local<v8::Object> mesh, const TopoDS_Face& face);
+
     static void Init(v8::Handle<v8::Object> target);
 
 
@@ -31,9 +140,33 @@ private:
     std::vector<unsigned int> edgeindices;
     std::vector<int> edgeranges;
     std::vector<int> edgehash;
+    std::unordered_set<int> m_edgeHashSet;   // the content of edgehash, for fast lookups
+    std::vector<MeshFaceRange> faceranges;
+    std::vector<TopoDS_Face> m_faces;         // the face of each range
+    bool m_pristine;                          // the faces are still as extracted ( see optimize )
+    bool m_separateFaceVertices;              // the vertex span of a face only holds vertices of that face
+    std::unordered_multimap<int, int> m_faceIndex; // face hash => index in faceranges ( built on demand )
     friend class MeshOptimizer;
 
-    void updateJavaScriptArray();
+    void extractFaceEdges(const TopoDS_Face& face, const occHandle(Poly_Triangulation)& triangulation,
+                          const TopLoc_Location& loc, size_t vsize);
+
+    // recompute the vertex span of each face from its triangles,
+    // and whether the spans of the faces are still separate
+    void updateFaceVertexRanges();
+
+    // compact interleaved encoding ( empty unless requested )
+    std::vector<unsigned char> encoded;
+    MeshEncoding encoding;
+    friend class MeshEncoder;
+    friend class GLBWriter;
+
+    MeshStatistics m_statistics;
+
+    bool   m_exposed;        // true once a native buffer is shared with javascript
+    size_t m_externalMemory; // bytes reported to V8 as external memory
+
+    v8::Local<v8::Object> createJavaScriptArray(const char* name);
 public:
     static Nan::Persistent<v8::FunctionTemplate> _template;
     int32_t numTriangles()  {
@@ -45,9 +178,38 @@ public:
     int32_t numNormals()  {
         return (int32_t)normals.size();
     }
+    int32_t numFaces()  {
+        return (int32_t)faceranges.size();
+    }
     int32_t numEdges()  {
         return (int32_t)edgeindices.size();
     }
+    int32_t numUVNormals()  {
+        return m_statistics.nbUVNormals;
+    }
+    int32_t numProjectedNormals()  {
+        return m_statistics.nbProjectedNormals;
+    }
+    double uvNormalsTime()  {
+        return m_statistics.uvNormalsTime;
+    }
+    double projectedNormalsTime()  {
+        return m_statistics.projectedNormalsTime;
+    }
+    int32_t numWeldedVertices()  {
+        return m_statistics.nbWeldedVertices;
+    }
+    int32_t numReusedFaces()  {
+        return m_statistics.nbReusedFaces;
+    }
+    int32_t numCachedFaces()  {
+        return m_statistics.nbCachedFaces;
+    }
+    int32_t numDecimatedTriangles()  {
+        return m_statistics.nbDecimatedTriangles;
+    }
+    // average vertex cache miss ratio of the triangle order
+    double acmr();
 
     void setErrorMessage(const char* message) {};
 
@@ -0,0 +1,114 @@
+#include "MeshEncoder.h"
+
+#include <cmath>
+#include <string.h>
+#include <assert.h>
+
+static const size_t kVertexStride = 8;
+
+static inline unsigned short quantizeUnorm16(double v, double offset, double scale)
+{
+  if (scale <= 0) {
+    return 0;
+  }
+  double q = floor((v - offset) / scale + 0.5);
+  if (q < 0) q = 0;
+  if (q > 65535) q = 65535;
+  return (unsigned short)q;
+}
+
+static inline signed char quantizeSnorm8(double v)
+{
+  if (v < -1) v = -1;
+  if (v > 1) v = 1;
+  return (signed char)floor(v * 127.0 + (v >= 0 ? 0.5 : -0.5));
+}
+
+// octahedral projection of a unit vector
+static inline void octEncode(const Coord3f& n, signed char* out)
+{
+  double l = fabs(n.x) + fabs(n.y) + fabs(n.z);
+  double u = 0, v = 0;
+  if (l > 0) {
+    u = n.x / l;
+    v = n.y / l;
+    if (n.z < 0) {
+      double pu = (1.0 - fabs(v)) * (u >= 0 ? 1.0 : -1.0);
+      double pv = (1.0 - fabs(u)) * (v >= 0 ? 1.0 : -1.0);
+      u = pu;
+      v = pv;
+    }
+  }
+  out[0] = quantizeSnorm8(u);
+  out[1] = quantizeSnorm8(v);
+}
+
+template <typename Index>
+static void writeIndices(unsigned char* dest, const int* src, size_t count)
+{
+  Index* out = reinterpret_cast<Index*>(dest);
+  for (size_t i = 0; i < count; i++) {
+    out[i] = (Index)src[i];
+  }
+}
+
+void MeshEncoder::encodeQuantized(Mesh& mesh)
+{
+  assert(!mesh.m_exposed);
+  assert(sizeof(mesh.triangles[0]) == sizeof(int) * 3);
+
+  const size_t nbVertices = mesh.vertices.size();
+  MeshEncoding& enc = mesh.encoding;
+  enc = MeshEncoding();
+
+  // the bounding box of the triangulated shape
+  double bmin[3] = { 0, 0, 0 };
+  double bmax[3] = { 0, 0, 0 };
+  for (size_t v = 0; v < nbVertices; v++) {
+    const float p[3] = { mesh.vertices[v].x, mesh.vertices[v].y, mesh.vertices[v].z };
+    for (int c = 0; c < 3; c++) {
+      if (v == 0 || p[c] < bmin[c]) bmin[c] = p[c];
+      if (v == 0 || p[c] > bmax[c]) bmax[c] = p[c];
+    }
+  }
+  for (int c = 0; c < 3; c++) {
+    enc.positionOffset[c] = bmin[c];
+    enc.positionScale[c] = (bmax[c] - bmin[c]) / 65535.0;
+  }
+
+  enc.vertexCount = nbVertices;
+  enc.vertexStride = kVertexStride;
+  enc.uint16Indices = nbVertices <= 65536;
+  const size_t indexSize = enc.uint16Indices ? 2 : 4;
+
+  enc.indexCount = mesh.triangles.size() * 3;
+  enc.edgeIndexCount = mesh.edgeindices.size();
+  enc.indexByteOffset = nbVertices * kVertexStride;
+  enc.edgeIndexByteOffset = enc.indexByteOffset + enc.indexCount * indexSize;
+  const size_t byteLength = enc.edgeIndexByteOffset + enc.edgeIndexCount * indexSize;
+
+  std::vector<unsigned char>(byteLength, 0).swap(mesh.encoded);
+  unsigned char* data = mesh.encoded.data();
+
+  for (size_t v = 0; v < nbVertices; v++) {
+    unsigned char* vertex = data + v * kVertexStride;
+    const Coord3f& p = mesh.vertices[v];
+    unsigned short q[3] = {
+      quantizeUnorm16(p.x, enc.positionOffset[0], enc.positionScale[0]),
+      quantizeUnorm16(p.y, enc.positionOffset[1], enc.positionScale[1]),
+      quantizeUnorm16(p.z, enc.positionOffset[2], enc.positionScale[2])
+    };
+    memcpy(vertex, q, sizeof(q));
+    octEncode(mesh.normals[v], reinterpret_cast<signed char*>(vertex + sizeof(q)));
+  }
+
+  const int* indices = reinterpret_cast<const int*>(mesh.triangles.data());
+  const int* edgeIndices = reinterpret_cast<const int*>(mesh.edgeindices.data());
+  if (enc.uint16Indices) {
+    writeIndices<unsigned short>(data + enc.indexByteOffset, indices, enc.indexCount);
+    writeIndices<unsigned short>(data + enc.edgeIndexByteOffset, edgeIndices, enc.edgeIndexCount);
+  } else {
+    writeIndices<unsigned int>(data + enc.indexByteOffset, indices, enc.indexCount);
+    writeIndices<unsigned int>(data + enc.edgeIndexByteOffset, edgeIndices, enc.edgeIndexCount);
+  }
+}
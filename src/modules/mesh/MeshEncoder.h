@@ -0,0 +1,23 @@
+#pragma once
+#include "Mesh.h"
+
+//
+// compact encoding of the native buffers of a mesh in one interleaved buffer
+// ( must be called before the javascript typed arrays are created )
+//
+// layout of the buffer :
+//   vertexCount * 8 bytes : Uint16 x,y,z  quantized in the bounding box
+//                           Int8   nu,nv  octahedral encoded normal
+//   indexCount  * 2|4     : triangle indices ( Uint16 when the vertex count allows )
+//   edgeIndexCount * 2|4  : edge indices ( same type as the triangle indices )
+//
+// decoding ( see mesh.encoding ) :
+//   position = positionOffset + q * positionScale
+//   u = nu / 127, v = nv / 127, z = 1 - |u| - |v|
+//   if (z < 0) { u' = (1 - |v|) * sign(u); v' = (1 - |u|) * sign(v) }
+//   normal = normalize(u', v', z)
+//
+class MeshEncoder {
+public:
+  static void encodeQuantized(Mesh& mesh);
+};
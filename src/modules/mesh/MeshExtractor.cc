@@ -0,0 +1,697 @@
+#include "MeshExtractor.h"
+#include "Util.h"
+#include "FaceMeshCache.h"
+
+#include <uv.h>
+#include <algorithm>
+#include <string.h>
+#include <assert.h>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+
+bool ReadMeshParameters(v8::Local<v8::Value> value, MeshParameters& params)
+{
+  if (value.IsEmpty() || !value->IsObject() || value->IsFunction()) {
+    return true;
+  }
+  v8::Local<v8::Object> options = value->ToObject();
+  v8::Local<v8::Value> mode = options->Get(Nan::New("deflectionMode").ToLocalChecked());
+  if (!mode.IsEmpty() && mode->IsString()) {
+    Nan::Utf8String str(mode);
+    if (!strcmp(*str, "edge")) {
+      params.deflectionMode = MeshParameters::EDGE_RELATIVE;
+    } else if (!strcmp(*str, "absolute")) {
+      params.deflectionMode = MeshParameters::ABSOLUTE;
+    } else if (!strcmp(*str, "relative")) {
+      params.deflectionMode = MeshParameters::SHAPE_RELATIVE;
+    } else if (!strcmp(*str, "screen")) {
+      params.deflectionMode = MeshParameters::SCREEN_SPACE;
+    }
+  }
+  params.pixelError     = ReadDouble(options, "pixelError", params.pixelError);
+  params.cameraDistance = ReadDouble(options, "cameraDistance", params.cameraDistance);
+  params.fieldOfView    = ReadDouble(options, "fieldOfView", params.fieldOfView);
+  params.viewportHeight = ReadDouble(options, "viewportHeight", params.viewportHeight);
+  if (params.deflectionMode == MeshParameters::SCREEN_SPACE && !(params.cameraDistance > 0)) {
+    Nan::ThrowError("the screen deflection mode expects a positive cameraDistance");
+    return false;
+  }
+
+  params.qualityNormals = ReadBool(options, "qualityNormals", params.qualityNormals);
+  params.parallel       = ReadBool(options, "parallel", params.parallel);
+  params.weld           = ReadBool(options, "weld", params.weld);
+  params.weldTolerance  = ReadDouble(options, "weldTolerance", params.weldTolerance);
+  params.creaseAngle    = ReadDouble(options, "creaseAngle", params.creaseAngle);
+  params.vertexCache    = ReadBool(options, "vertexCache", params.vertexCache);
+  params.overdraw       = ReadBool(options, "overdraw", params.overdraw);
+
+  v8::Local<v8::Value> decimate = options->Get(Nan::New("decimate").ToLocalChecked());
+  if (!decimate.IsEmpty() && decimate->IsObject()) {
+    v8::Local<v8::Object> obj = decimate->ToObject();
+    const int targetTriangles = ReadInt(obj, "targetTriangles", 0);
+    params.targetTriangles = targetTriangles > 0 ? (size_t)targetTriangles : 0;
+    params.targetRatio     = ReadDouble(obj, "ratio", 0);
+    params.maxError        = ReadDouble(obj, "maxError", 0);
+    params.decimate = params.targetTriangles > 0 || params.targetRatio > 0 || params.maxError > 0;
+  }
+
+  v8::Local<v8::Value> encoding = options->Get(Nan::New("encoding").ToLocalChecked());
+  if (!encoding.IsEmpty() && encoding->IsString()) {
+    Nan::Utf8String str(encoding);
+    if (!strcmp(*str, "quantized")) {
+      params.encoding = MeshParameters::QUANTIZED;
+    } else if (!strcmp(*str, "float32")) {
+      params.encoding = MeshParameters::FLOAT32;
+    }
+  }
+  return true;
+}
+
+
+void collectMeshFaces(const TopoDS_Shape& shape, std::vector<TopoDS_Face>& faces)
+{
+  if (shape.IsNull()) {
+    return;
+  }
+  if (shape.ShapeType() == TopAbs_COMPSOLID || shape.ShapeType() == TopAbs_COMPOUND) {
+    TopExp_Explorer exSolid, exFace;
+    for (exSolid.Init(shape, TopAbs_SOLID); exSolid.More(); exSolid.Next()) {
+      const TopoDS_Solid& solid = TopoDS::Solid(exSolid.Current());
+      for (exFace.Init(solid, TopAbs_FACE); exFace.More(); exFace.Next()) {
+        const TopoDS_Face& face = TopoDS::Face(exFace.Current());
+        if (face.IsNull()) continue;
+        faces.push_back(face);
+      }
+    }
+  } else {
+    TopExp_Explorer exFace;
+    for (exFace.Init(shape, TopAbs_FACE); exFace.More(); exFace.Next()) {
+      const TopoDS_Face& face = TopoDS::Face(exFace.Current());
+      if (face.IsNull()) continue;
+      faces.push_back(face);
+    }
+  }
+}
+
+
+//
+// work shared by the threads of the pool : each thread picks the next
+// face to extract and writes its mesh into its own buffers.
+//
+struct FaceExtractionJob {
+  const std::vector<TopoDS_Face>* faces;
+  std::vector<Mesh*>* parts;
+  bool qualityNormals;
+  MeshProgressListener* listener;
+
+  uv_mutex_t mutex;
+  size_t nextFace;
+  size_t nbExtracted;
+};
+
+static void extractFaceWorker(void* arg)
+{
+  FaceExtractionJob* job = static_cast<FaceExtractionJob*>(arg);
+  const size_t nbFaces = job->faces->size();
+  for (;;) {
+    size_t i;
+    uv_mutex_lock(&job->mutex);
+    i = job->nextFace++;
+    uv_mutex_unlock(&job->mutex);
+    if (i >= nbFaces) {
+      break;
+    }
+
+    Mesh* part = (*job->parts)[i];
+    part->extractFaceMesh((*job->faces)[i], job->qualityNormals);
+
+    uv_mutex_lock(&job->mutex);
+    size_t nbExtracted = ++job->nbExtracted;
+    if (job->listener) {
+      job->listener->onFaceExtracted(nbExtracted, nbFaces);
+    }
+    uv_mutex_unlock(&job->mutex);
+  }
+}
+
+static uv_once_t threadBudget_once = UV_ONCE_INIT;
+static uv_mutex_t threadBudget_mutex;
+static int nbCpus = 1;
+static size_t threadBudget = 0; // extra threads that can still be started
+
+static void initThreadBudget()
+{
+  uv_cpu_info_t* cpus = 0;
+  int count = 0;
+  if (uv_cpu_info(&cpus, &count) == 0) {
+    uv_free_cpu_info(cpus, count);
+    nbCpus = count < 1 ? 1 : count;
+  }
+  threadBudget = (size_t)nbCpus;
+  uv_mutex_init(&threadBudget_mutex);
+}
+
+int numberOfThreads()
+{
+  uv_once(&threadBudget_once, initThreadBudget);
+  return nbCpus;
+}
+
+void runInParallel(void (*work)(void*), void* arg, size_t nbThreads)
+{
+  uv_once(&threadBudget_once, initThreadBudget);
+
+  size_t nbExtraThreads = 0;
+  if (nbThreads > 1) {
+    uv_mutex_lock(&threadBudget_mutex);
+    nbExtraThreads = std::min(nbThreads - 1, threadBudget);
+    threadBudget -= nbExtraThreads;
+    uv_mutex_unlock(&threadBudget_mutex);
+  }
+
+  std::vector<uv_thread_t> threads;
+  threads.reserve(nbExtraThreads);
+  for (size_t t = 0; t < nbExtraThreads; t++) {
+    uv_thread_t tid;
+    if (uv_thread_create(&tid, work, arg) == 0) {
+      threads.push_back(tid);
+    }
+  }
+  // the calling thread takes its share of the work
+  work(arg);
+  for (size_t t = 0; t < threads.size(); t++) {
+    uv_thread_join(&threads[t]);
+  }
+
+  if (nbExtraThreads > 0) {
+    uv_mutex_lock(&threadBudget_mutex);
+    threadBudget += nbExtraThreads;
+    uv_mutex_unlock(&threadBudget_mutex);
+  }
+}
+
+// extract each face in its own part ( in a pool of threads in parallel mode )
+static void extractFaceParts(const std::vector<TopoDS_Face>& faces, const MeshParameters& params,
+                             std::vector<Mesh*>& parts, MeshProgressListener* listener)
+{
+  const size_t nbFaces = faces.size();
+
+  parts.resize(nbFaces);
+  for (size_t i = 0; i < nbFaces; i++) {
+    parts[i] = new Mesh();
+  }
+
+  FaceExtractionJob job;
+  job.faces = &faces;
+  job.parts = &parts;
+  job.qualityNormals = params.qualityNormals;
+  job.listener = listener;
+  job.nextFace = 0;
+  job.nbExtracted = 0;
+  uv_mutex_init(&job.mutex);
+
+  const size_t nbThreads = params.parallel ? std::min((size_t)numberOfThreads(), nbFaces) : 1;
+  runInParallel(extractFaceWorker, &job, nbThreads);
+  uv_mutex_destroy(&job.mutex);
+}
+
+static void extractFacesMeshInParallel(Mesh& mesh, const std::vector<TopoDS_Face>& faces, const MeshParameters& params,
+                                       MeshProgressListener* listener)
+{
+  std::vector<Mesh*> parts;
+  extractFaceParts(faces, params, parts, listener);
+
+  mesh.concatenate(parts);
+
+  for (size_t i = 0; i < parts.size(); i++) {
+    delete parts[i];
+  }
+}
+
+void extractFacesMesh(Mesh& mesh, const std::vector<TopoDS_Face>& faces, const MeshParameters& params,
+                      MeshProgressListener* listener)
+{
+  if (params.parallel && faces.size() > 1) {
+    extractFacesMeshInParallel(mesh, faces, params, listener);
+    return;
+  }
+  const size_t nbFaces = faces.size();
+  for (size_t i = 0; i < nbFaces; i++) {
+    mesh.extractFaceMesh(faces[i], params.qualityNormals);
+    if (listener) {
+      listener->onFaceExtracted(i + 1, nbFaces);
+    }
+  }
+}
+
+//
+// when all the faces are found in the FaceMeshCache, the shape is neither
+// triangulated nor extracted again.
+// otherwise the whole shape is triangulated and all its faces are extracted and
+// added to the cache : triangulating the missing faces alone could discretize
+// their edges differently from the cached neighbours and leave cracks.
+//
+static void meshShapeWithCache(Mesh& mesh, const TopoDS_Shape& shape, const std::vector<TopoDS_Face>& faces,
+                               const MeshParameters& params, MeshProgressListener* listener)
+{
+  FaceMeshCache& cache = FaceMeshCache::instance();
+
+  std::vector<FaceMeshCache::Part> parts(faces.size());
+  bool complete = true;
+  for (size_t i = 0; i < faces.size() && complete; i++) {
+    parts[i] = cache.find(faces[i], params);
+    complete = parts[i] ? true : false;
+  }
+
+  if (complete) {
+    std::vector<Mesh*> rawParts(parts.size());
+    for (size_t i = 0; i < parts.size(); i++) {
+      rawParts[i] = parts[i].get();
+    }
+    mesh.concatenate(rawParts);
+    mesh.statistics().nbCachedFaces += (int)faces.size();
+    if (listener && !faces.empty()) {
+      listener->onFaceExtracted(faces.size(), faces.size());
+    }
+    return;
+  }
+
+  triangulateShape(shape, params);
+
+  std::vector<Mesh*> extracted;
+  extractFaceParts(faces, params, extracted, listener);
+  mesh.concatenate(extracted);
+
+  // the cached parts must not count their extraction statistics twice
+  for (size_t i = 0; i < extracted.size(); i++) {
+    FaceMeshCache::Part part(extracted[i]);
+    if (part->numFaces() != 1) {
+      continue;  // the extraction has failed
+    }
+    part->statistics() = MeshStatistics();
+    cache.insert(faces[i], params, part);
+  }
+}
+
+MeshParameters resolveDeflection(const TopoDS_Shape& shape, const MeshParameters& params)
+{
+  MeshParameters resolved = params;
+  if (params.deflectionMode != MeshParameters::SHAPE_RELATIVE &&
+      params.deflectionMode != MeshParameters::SCREEN_SPACE) {
+    return resolved;
+  }
+
+  Bnd_Box box;
+  BRepBndLib::Add(shape, box);
+  const double diagonal = box.IsVoid() ? 0.0 : sqrt(box.SquareExtent());
+
+  double deflection = 0.0;
+  if (params.deflectionMode == MeshParameters::SHAPE_RELATIVE) {
+    deflection = params.deflection * diagonal;
+  } else {
+    // size of a pixel at the distance of the camera
+    const double pixelSize = 2.0 * params.cameraDistance * tan(params.fieldOfView / 2.0)
+                           / std::max(params.viewportHeight, 1.0);
+    deflection = params.pixelError * pixelSize;
+  }
+  // never go below a ten thousandth of the shape size : a finer deflection
+  // would only produce a huge triangulation
+  const double minimum = std::max(diagonal * 1E-4, 1E-7);
+  resolved.deflection = std::max(deflection, minimum);
+  resolved.deflectionMode = MeshParameters::ABSOLUTE;
+  return resolved;
+}
+
+void triangulateShape(const TopoDS_Shape& shape, const MeshParameters& params)
+{
+  assert(params.deflectionMode == MeshParameters::EDGE_RELATIVE ||
+         params.deflectionMode == MeshParameters::ABSOLUTE);
+
+  // let BRepMesh triangulate the faces in parallel
+  const Standard_Boolean isRelative = params.deflectionMode == MeshParameters::EDGE_RELATIVE ? Standard_True : Standard_False;
+  const Standard_Boolean inParallel = Standard_True;
+  BRepMesh_IncrementalMesh MSH(shape, params.deflection, isRelative, params.angle, inParallel);
+}
+
+static void meshShape(Mesh& mesh, const TopoDS_Shape& shape, const MeshParameters& parameters,
+                      MeshProgressListener* listener, bool useCache)
+{
+  const MeshParameters params = resolveDeflection(shape, parameters);
+
+  std::vector<TopoDS_Face> faces;
+  collectMeshFaces(shape, faces);
+
+  if (useCache && FaceMeshCache::instance().enabled()) {
+    meshShapeWithCache(mesh, shape, faces, params, listener);
+    return;
+  }
+
+  triangulateShape(shape, params);
+
+  extractFacesMesh(mesh, faces, params, listener);
+}
+
+void meshShape(Mesh& mesh, const TopoDS_Shape& shape, const MeshParameters& params,
+               MeshProgressListener* listener)
+{
+  meshShape(mesh, shape, params, listener, true);
+}
+
+//
+// the faces of a copy are new TShapes, never found in the FaceMeshCache : caching
+// them would only keep the copy alive and evict the faces of the shapes held by
+// javascript, so the cache is bypassed.
+//
+void meshShape(Mesh& mesh, const MeshShapeCopy& copy, const MeshParameters& params,
+               MeshProgressListener* listener)
+{
+  meshShape(mesh, copy.shape(), params, listener, false);
+  copy.relabel(mesh);
+}
+
+//
+// when copy is given, shape is copy->shape() : the faces and edges of each
+// chunk are given the identity of the original ones before it is optimized.
+//
+static void meshShapeInChunks(const TopoDS_Shape& shape, const MeshShapeCopy* copy,
+                              const MeshParameters& parameters, size_t chunkTriangles,
+                              MeshChunkListener* chunkListener, MeshProgressListener* listener)
+{
+  const MeshParameters params = resolveDeflection(shape, parameters);
+
+  std::vector<TopoDS_Face> faces;
+  collectMeshFaces(shape, faces);
+
+  triangulateShape(shape, params);
+
+  const size_t nbFaces = faces.size();
+  MeshChunk chunk;
+  chunk.mesh = new Mesh();
+  size_t firstFace = 0;
+  try {
+    for (size_t i = 0; i < nbFaces; i++) {
+      chunk.mesh->extractFaceMesh(faces[i], params.qualityNormals);
+      if (listener) {
+        listener->onFaceExtracted(i + 1, nbFaces);
+      }
+      if ((size_t)chunk.mesh->numTriangles() < chunkTriangles && i + 1 < nbFaces) {
+        continue;
+      }
+      // the next chunk skips the edges already extracted, which are known by their hash in the copy
+      Mesh* next = new Mesh();
+      next->takeEdgeHashes(*chunk.mesh);
+
+      if (copy) {
+        copy->relabel(*chunk.mesh, firstFace, i + 1 - firstFace);
+      }
+      firstFace = i + 1;
+      chunk.mesh->optimize(params);
+
+      // the listener owns the ready chunk, even if onChunk throws
+      const MeshChunk ready = chunk;
+      chunk.mesh = next;
+      chunk.index++;
+      chunk.firstVertex += (size_t)ready.mesh->numVertices();
+      chunk.firstTriangle += (size_t)ready.mesh->numTriangles();
+
+      chunkListener->onChunk(ready);
+    }
+  } catch (...) {
+    delete chunk.mesh;
+    throw;
+  }
+  delete chunk.mesh;
+}
+
+void meshShapeInChunks(const TopoDS_Shape& shape, const MeshParameters& params, size_t chunkTriangles,
+                       MeshChunkListener* chunkListener, MeshProgressListener* listener)
+{
+  meshShapeInChunks(shape, 0, params, chunkTriangles, chunkListener, listener);
+}
+
+void meshShapeInChunks(const MeshShapeCopy& copy, const MeshParameters& params, size_t chunkTriangles,
+                       MeshChunkListener* chunkListener, MeshProgressListener* listener)
+{
+  meshShapeInChunks(copy.shape(), &copy, params, chunkTriangles, chunkListener, listener);
+}
+
+//
+// reports the extraction of the changed faces of meshShapeIncremental as the
+// progression of the whole shape, the reused faces being counted first
+//
+class IncrementalProgress : public MeshProgressListener {
+public:
+  IncrementalProgress(MeshProgressListener* listener, size_t nbReused, size_t nbFaces)
+    : m_listener(listener), m_nbReused(nbReused), m_nbFaces(nbFaces) {}
+
+  virtual void onFaceExtracted(size_t nbExtractedFaces, size_t /*nbFaces*/)
+  {
+    m_listener->onFaceExtracted(m_nbReused + nbExtractedFaces, m_nbFaces);
+  }
+private:
+  MeshProgressListener* m_listener;
+  size_t m_nbReused;
+  size_t m_nbFaces;
+};
+
+void meshShapeIncremental(Mesh& mesh, const TopoDS_Shape& shape, const MeshParameters& parameters,
+                          const std::vector<Mesh*>& sources, MeshProgressListener* listener)
+{
+  const MeshParameters params = resolveDeflection(shape, parameters);
+
+  std::vector<TopoDS_Face> faces;
+  collectMeshFaces(shape, faces);
+
+  // look for the faces that are identical in one of the source meshes
+  std::vector<std::pair<Mesh*, int> > reused(faces.size(), std::make_pair((Mesh*)0, -1));
+  size_t nbReused = 0;
+  for (size_t i = 0; i < faces.size(); i++) {
+    for (size_t s = 0; s < sources.size() && reused[i].first == 0; s++) {
+      const int index = sources[s]->findIdenticalFace(faces[i]);
+      if (index >= 0) {
+        reused[i] = std::make_pair(sources[s], index);
+        nbReused++;
+      }
+    }
+  }
+
+  // the whole shape is triangulated : BRepMesh keeps the triangulation of the
+  // unchanged faces and discretizes the edges they share with the changed faces
+  // once, so that no crack opens between them
+  triangulateShape(shape, params);
+
+  // the changed faces are taken from the cache or extracted ( in parallel mode, by a pool of threads )
+  FaceMeshCache& cache = FaceMeshCache::instance();
+  const bool useCache = cache.enabled();
+  std::vector<FaceMeshCache::Part> parts(faces.size());
+  std::vector<TopoDS_Face> missingFaces;
+  std::vector<size_t> missingIndices;
+  size_t nbCached = 0;
+  for (size_t i = 0; i < faces.size(); i++) {
+    if (reused[i].first) {
+      continue;
+    }
+    if (useCache) {
+      parts[i] = cache.find(faces[i], params);
+    }
+    if (parts[i]) {
+      nbCached++;
+      continue;
+    }
+    missingFaces.push_back(faces[i]);
+    missingIndices.push_back(i);
+  }
+
+  std::vector<Mesh*> extracted;
+  if (listener) {
+    IncrementalProgress progress(listener, nbReused + nbCached, faces.size());
+    extractFaceParts(missingFaces, params, extracted, &progress);
+  } else {
+    extractFaceParts(missingFaces, params, extracted, 0);
+  }
+  for (size_t m = 0; m < extracted.size(); m++) {
+    parts[missingIndices[m]] = FaceMeshCache::Part(extracted[m]);
+  }
+
+  for (size_t i = 0; i < faces.size(); i++) {
+    if (reused[i].first && mesh.appendFaceMesh(*reused[i].first, reused[i].second)) {
+      continue;
+    }
+    if (!parts[i]) {
+      // the reused face has been meshed again by the triangulation of the shape
+      mesh.extractFaceMesh(faces[i], params.qualityNormals);
+      continue;
+    }
+    mesh.concatenate(std::vector<Mesh*>(1, parts[i].get()));
+  }
+  mesh.statistics().nbCachedFaces += (int)nbCached;
+
+  if (useCache) {
+    // the cached parts must not count their extraction statistics twice
+    for (size_t m = 0; m < missingIndices.size(); m++) {
+      const FaceMeshCache::Part& part = parts[missingIndices[m]];
+      if (part->numFaces() != 1) {
+        continue;  // the extraction has failed
+      }
+      part->statistics() = MeshStatistics();
+      cache.insert(faces[missingIndices[m]], params, part);
+    }
+  }
+  if (listener && missingFaces.empty() && !faces.empty()) {
+    listener->onFaceExtracted(faces.size(), faces.size());
+  }
+}
+
+void meshShapeLODs(std::vector<Mesh*>& meshes, const TopoDS_Shape& shape, const std::vector<double>& deflections,
+                   const MeshParameters& params)
+{
+  assert(meshes.size() == deflections.size());
+  if (deflections.empty()) {
+    return;
+  }
+
+  std::vector<MeshParameters> levels(deflections.size());
+  size_t finest = 0;
+  for (size_t i = 0; i < deflections.size(); i++) {
+    levels[i] = params;
+    levels[i].deflection = deflections[i];
+    levels[i] = resolveDeflection(shape, levels[i]);
+    if (levels[i].deflection < levels[finest].deflection) {
+      finest = i;
+    }
+  }
+
+  // the finest level is the one that stays attached to the shape
+  meshShape(*meshes[finest], shape, levels[finest]);
+
+  if (deflections.size() == 1) {
+    return;
+  }
+
+  // the coarser levels are triangulated on a copy of the shape, the faces and
+  // edges of the copy are found in the same order as the ones of the shape
+  BRepBuilderAPI_Copy copier(shape);
+  const TopoDS_Shape& copy = copier.Shape();
+
+  std::vector<TopoDS_Face> faces;
+  collectMeshFaces(shape, faces);
+  std::vector<TopoDS_Face> copyFaces;
+  collectMeshFaces(copy, copyFaces);
+
+  TopTools_IndexedMapOfShape edges;
+  TopExp::MapShapes(shape, TopAbs_EDGE, edges);
+  TopTools_IndexedMapOfShape copyEdges;
+  TopExp::MapShapes(copy, TopAbs_EDGE, copyEdges);
+  std::unordered_map<int, int> edgeHashes;
+  for (int e = 1; e <= edges.Extent() && e <= copyEdges.Extent(); e++) {
+    edgeHashes[copyEdges(e).HashCode(std::numeric_limits<int>::max())] = edges(e).HashCode(std::numeric_limits<int>::max());
+  }
+
+  for (size_t i = 0; i < levels.size(); i++) {
+    if (i == finest) {
+      continue;
+    }
+    BRepTools::Clean(copy);
+    triangulateShape(copy, levels[i]);
+    extractFacesMesh(*meshes[i], copyFaces, levels[i]);
+    if ((size_t)meshes[i]->numFaces() == faces.size()) {
+      meshes[i]->relabel(faces, edgeHashes);
+    }
+  }
+}
+
+
+MeshShapeCopy::MeshShapeCopy(const TopoDS_Shape& shape)
+{
+  if (shape.IsNull()) {
+    return;
+  }
+  BRepBuilderAPI_Copy copier(shape);
+  m_copy = copier.Shape();
+
+  collectMeshFaces(shape, m_faces);
+
+  TopTools_IndexedMapOfShape edges;
+  TopExp::MapShapes(shape, TopAbs_EDGE, edges);
+  TopTools_IndexedMapOfShape copyEdges;
+  TopExp::MapShapes(m_copy, TopAbs_EDGE, copyEdges);
+  for (int e = 1; e <= edges.Extent() && e <= copyEdges.Extent(); e++) {
+    m_edgeHashes[copyEdges(e).HashCode(std::numeric_limits<int>::max())] = edges(e).HashCode(std::numeric_limits<int>::max());
+  }
+}
+
+void MeshShapeCopy::relabel(Mesh& mesh) const
+{
+  relabel(mesh, 0, m_faces.size());
+}
+
+void MeshShapeCopy::relabel(Mesh& mesh, size_t firstFace, size_t nbFaces) const
+{
+  // a face that could not be extracted breaks the correspondence
+  if ((size_t)mesh.numFaces() != nbFaces || firstFace + nbFaces > m_faces.size()) {
+    return;
+  }
+  if (nbFaces == m_faces.size()) {
+    mesh.relabel(m_faces, m_edgeHashes);
+    return;
+  }
+  const std::vector<TopoDS_Face> faces(m_faces.begin() + firstFace, m_faces.begin() + firstFace + nbFaces);
+  mesh.relabel(faces, m_edgeHashes);
+}
+
+
+static void appendMatrix(const TopLoc_Location& location, std::vector<double>& matrices)
+{
+  const gp_Trsf trsf = location.Transformation();
+  for (int col = 1; col <= 4; col++) {
+    for (int row = 1; row <= 3; row++) {
+      matrices.push_back(trsf.Value(row, col));
+    }
+    matrices.push_back(col == 4 ? 1.0 : 0.0);
+  }
+}
+
+static void collectInstances(const TopoDS_Shape& shape, const TopLoc_Location& parent, bool root,
+                             MeshInstances& instances,
+                             TopTools_DataMapOfShapeInteger& forward, TopTools_DataMapOfShapeInteger& reversed)
+{
+  const TopLoc_Location location = parent * shape.Location();
+
+  if (shape.ShapeType() == TopAbs_COMPOUND || shape.ShapeType() == TopAbs_COMPSOLID) {
+    // the children are iterated with their own location only
+    for (TopoDS_Iterator it(shape, Standard_True, Standard_False); it.More(); it.Next()) {
+      collectInstances(it.Value(), location, false, instances, forward, reversed);
+    }
+    return;
+  }
+  // like collectMeshFaces, only the solids of a compound are meshed
+  if (!root && shape.ShapeType() != TopAbs_SOLID) {
+    return;
+  }
+
+  // a reversed occurrence has its triangles flipped : it needs its own prototype
+  const TopoDS_Shape prototype = shape.Located(TopLoc_Location());
+  TopTools_DataMapOfShapeInteger& index = prototype.Orientation() == TopAbs_REVERSED ? reversed : forward;
+  int p;
+  if (index.IsBound(prototype)) {
+    p = index.Find(prototype);
+  } else {
+    p = (int)instances.prototypes.size();
+    instances.prototypes.push_back(prototype);
+    index.Bind(prototype, p);
+  }
+  instances.prototypeIndex.push_back(p);
+  appendMatrix(location, instances.matrices);
+}
+
+void collectInstances(const TopoDS_Shape& shape, MeshInstances& instances)
+{
+  if (shape.IsNull()) {
+    return;
+  }
+  TopTools_DataMapOfShapeInteger forward;
+  TopTools_DataMapOfShapeInteger reversed;
+  collectInstances(shape, TopLoc_Location(), true, instances, forward, reversed);
+}
@@ -0,0 +1,224 @@
+#pragma once
+#include "OCC.h"
+#include "NodeV8.h"
+#include "Mesh.h"
+
+#include <vector>
+#include <unordered_map>
+
+// parameters used to triangulate a shape and extract its mesh
+struct MeshParameters {
+  MeshParameters();
+
+  // how the deflection is interpreted
+  enum DeflectionMode {
+    EDGE_RELATIVE,   // relative to the size of each edge ( BRepMesh relative mode )
+    ABSOLUTE,        // in model units
+    SHAPE_RELATIVE,  // fraction of the bounding box diagonal of the shape
+    SCREEN_SPACE     // derived from a pixel error seen from a camera ( deflection is ignored )
+  };
+
+  enum Encoding {
+    FLOAT32,    // Float32 positions and normals, Int32 indices only
+    QUANTIZED   // also build the compact interleaved buffer ( see MeshEncoder )
+  };
+
+  double deflection;
+  double angle;          // angular deflection in radians
+  DeflectionMode deflectionMode;
+
+  // screen space error mode
+  double pixelError;     // maximum error in pixels
+  double cameraDistance; // distance from the camera to the shape, in model units
+  double fieldOfView;    // vertical field of view in radians
+  double viewportHeight; // in pixels
+  bool   qualityNormals; // evaluate normals on the surface instead of averaging triangle normals
+  bool   parallel;       // extract the faces in a pool of threads
+
+  bool   weld;           // merge the vertices shared by adjacent faces
+  double weldTolerance;
+  double creaseAngle;    // vertices whose normals differ more than this angle (radians) are not merged
+
+  bool   vertexCache;    // reorder triangles and vertices for the GPU vertex cache
+  bool   overdraw;       // also sort the triangle clusters to reduce overdraw
+
+  bool   decimate;       // simplify the triangulation ( see MeshOptimizer::decimate )
+  size_t targetTriangles;// stop when the mesh has no more triangles ( 0 : no target )
+  double targetRatio;    // same as a fraction of the initial number of triangles
+  double maxError;       // maximum displacement of the surface in model units ( 0 : unlimited )
+
+  Encoding encoding;
+};
+
+inline MeshParameters::MeshParameters()
+  : deflection(0.5)
+  , angle(20 * 3.14159 / 180.0)
+  , deflectionMode(EDGE_RELATIVE)
+  , pixelError(1.0)
+  , cameraDistance(0.0)
+  , fieldOfView(45 * 3.14159 / 180.0)
+  , viewportHeight(1080)
+  , qualityNormals(true)
+  , parallel(false)
+  , weld(false)
+  , weldTolerance(1E-6)
+  , creaseAngle(30 * 3.14159 / 180.0)
+  , vertexCache(false)
+  , overdraw(false)
+  , decimate(false)
+  , targetTriangles(0)
+  , targetRatio(0)
+  , maxError(0)
+  , encoding(FLOAT32)
+{}
+
+// read the optional members of a javascript option object
+// { deflectionMode: "edge" | "absolute" | "relative" | "screen",
+//   pixelError: <pixels>, cameraDistance: <number>, fieldOfView: <radians>, viewportHeight: <pixels>,
+//   qualityNormals: <bool>, parallel: <bool>,
+//   weld: <bool>, weldTolerance: <number>, creaseAngle: <radians>,
+//   vertexCache: <bool>, overdraw: <bool>, encoding: "float32" | "quantized",
+//   decimate: { targetTriangles: <int>, ratio: <0..1>, maxError: <number> } }
+// ( throws a javascript error and returns false when the "screen" mode has no
+//   positive cameraDistance )
+bool ReadMeshParameters(v8::Local<v8::Value> options, MeshParameters& params);
+
+// convert the shape relative and screen space deflections into an absolute
+// deflection for this shape ( the other modes are left unchanged )
+MeshParameters resolveDeflection(const TopoDS_Shape& shape, const MeshParameters& params);
+
+// triangulate the shape with BRepMesh according to the deflection mode
+// ( which must have been resolved )
+void triangulateShape(const TopoDS_Shape& shape, const MeshParameters& params);
+
+// receives the progression of the face extraction
+// ( may be called from any thread )
+class MeshProgressListener {
+public:
+  virtual void onFaceExtracted(size_t nbExtractedFaces, size_t nbFaces) = 0;
+};
+
+// a part of the mesh of a shape made of whole faces ( see meshShapeInChunks ).
+// the triangles index the vertices of the chunk : firstVertex must be added
+// to get the index of a vertex in the mesh of the whole shape.
+struct MeshChunk {
+  MeshChunk() : mesh(0), index(0), firstVertex(0), firstTriangle(0) {}
+  Mesh*  mesh;
+  size_t index;
+  size_t firstVertex;
+  size_t firstTriangle;
+};
+
+// receives the chunks of a mesh in order, the listener takes ownership of chunk.mesh
+// ( called from the thread that meshes the shape, it may block to limit the memory in use )
+class MeshChunkListener {
+public:
+  virtual void onChunk(const MeshChunk& chunk) = 0;
+};
+
+// number of threads used to extract faces in parallel ( one per cpu )
+int numberOfThreads();
+
+// run work(arg) in the calling thread and in up to nbThreads - 1 other threads,
+// returns when all of them are done ( work must pick its tasks from a shared counter ).
+// the extra threads are taken from a budget of numberOfThreads() threads shared by
+// the whole process : when several workers of the libuv pool run parallel passes
+// at the same time, the later ones get fewer threads ( or none ) instead of
+// starting numberOfThreads() threads each.
+void runInParallel(void (*work)(void*), void* arg, size_t nbThreads);
+
+// collect the faces of a shape that contribute to its mesh
+// ( for compounds and compsolids only the faces of the solids are considered )
+void collectMeshFaces(const TopoDS_Shape& shape, std::vector<TopoDS_Face>& faces);
+
+// extract the mesh of the faces and append them to the mesh.
+// In parallel mode, each face is extracted in its own buffers by a pool of
+// threads and the buffers are concatenated once in face order : the
+// resulting mesh is identical to the one obtained in serial mode.
+void extractFacesMesh(Mesh& mesh, const std::vector<TopoDS_Face>& faces, const MeshParameters& params,
+                      MeshProgressListener* listener = 0);
+
+// triangulate the shape and extract its mesh.
+// Note: this function doesn't use V8 and can be called from a worker thread,
+//       Standard_Failure exceptions are propagated to the caller.
+void meshShape(Mesh& mesh, const TopoDS_Shape& shape, const MeshParameters& params,
+               MeshProgressListener* listener = 0);
+
+// triangulate the shape and deliver its mesh as a sequence of chunks : a chunk
+// is handed to the chunk listener as soon as its faces hold chunkTriangles
+// triangles or more, so that only one chunk is built at a time.
+// faces are never split : a chunk holds at least chunkTriangles triangles
+// ( except the last one ) and may hold many more when a face is large.
+// the optimization passes are applied to each chunk on its own.
+void meshShapeInChunks(const TopoDS_Shape& shape, const MeshParameters& params, size_t chunkTriangles,
+                       MeshChunkListener* chunkListener, MeshProgressListener* listener = 0);
+
+// same as meshShape, but the faces that are identical ( same TShape, location
+// and orientation ) to a face of one of the source meshes are copied from it :
+// the whole shape is triangulated, which keeps the triangulation of these faces,
+// and only the other faces are extracted.
+// this is used after booleans and fillets where most faces are unchanged.
+void meshShapeIncremental(Mesh& mesh, const TopoDS_Shape& shape, const MeshParameters& params,
+                          const std::vector<Mesh*>& sources, MeshProgressListener* listener = 0);
+
+// mesh the shape at several levels of detail, meshes[i] receives the mesh for deflections[i].
+// the finest level is meshed first on the shape itself and keeps its triangulation,
+// the coarser levels are triangulated on a copy of the shape so that the levels
+// don't replace each other's triangulation.
+// the coarser levels are re-meshed rather than decimated from the finest one :
+// decimation keeps the outlines of the faces, so every level would keep all the
+// edge vertices of the finest one, whereas BRepMesh discretizes the shared edges
+// once per level and keeps each level watertight.
+void meshShapeLODs(std::vector<Mesh*>& meshes, const TopoDS_Shape& shape, const std::vector<double>& deflections,
+                   const MeshParameters& params);
+
+//
+// a copy of a shape made in the main loop thread, so that a working thread can
+// triangulate it without touching the shape shared with javascript : BRepMesh
+// stores the triangulation in the TShape of the faces, which the main loop may
+// be meshing or reading at the same time.
+// the faces and edges of the copy are found in the same order as the ones of the shape.
+//
+class MeshShapeCopy {
+public:
+  explicit MeshShapeCopy(const TopoDS_Shape& shape);
+
+  const TopoDS_Shape& shape() const {
+    return m_copy;
+  }
+
+  // give the faces and edges of a mesh of the copy the identity of the faces
+  // and edges of the original shape ( before the optimization passes )
+  void relabel(Mesh& mesh) const;
+  // same for a mesh made of the faces firstFace to firstFace + nbFaces - 1
+  // ( in the order of collectMeshFaces, see meshShapeInChunks )
+  void relabel(Mesh& mesh, size_t firstFace, size_t nbFaces) const;
+
+private:
+  TopoDS_Shape m_copy;
+  std::vector<TopoDS_Face> m_faces;          // the faces of the original shape
+  std::unordered_map<int, int> m_edgeHashes; // edge hash in the copy => edge hash in the shape
+};
+
+// same as meshShape, on the copy of a shape : the mesh gets the faces and edges
+// of the original shape. the FaceMeshCache is not used ( used by the working threads )
+void meshShape(Mesh& mesh, const MeshShapeCopy& copy, const MeshParameters& params,
+               MeshProgressListener* listener = 0);
+
+// same as meshShapeInChunks, on the copy of a shape : the chunks get the faces
+// and edges of the original shape ( used by the working threads )
+void meshShapeInChunks(const MeshShapeCopy& copy, const MeshParameters& params, size_t chunkTriangles,
+                       MeshChunkListener* chunkListener, MeshProgressListener* listener = 0);
+
+// the located occurrences of the distinct solids of a shape
+// ( the same TShape used under several locations is a single prototype )
+struct MeshInstances {
+  std::vector<TopoDS_Shape> prototypes; // without location
+  std::vector<int>    prototypeIndex;   // prototype of each instance
+  std::vector<double> matrices;         // 4x4 column major matrix of each instance
+  size_t size() const { return prototypeIndex.size(); }
+};
+
+// collect the prototypes and the instances of a shape : compounds and compsolids
+// are traversed down to their solids, any other shape is its own single instance
+void collectInstances(const TopoDS_Shape& shape, MeshInstances& instances);
@@ -0,0 +1,893 @@
+#include "MeshOptimizer.h"
+
+#include <cmath>
+#include <unordered_map>
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+#include <limits>
+
+static inline double square(double b)
+{
+  return b*b;
+}
+
+static inline double distance2(const Coord3f& a, const Coord3f& b)
+{
+  return square(a.x - b.x) + square(a.y - b.y) + square(a.z - b.z);
+}
+
+static inline double dot(const Coord3f& a, const Coord3f& b)
+{
+  return double(a.x)*b.x + double(a.y)*b.y + double(a.z)*b.z;
+}
+
+// hash key of a cell of the uniform grid
+// ( different cells may share a key : candidates are always checked by distance )
+static inline uint64_t cellKey(int64_t ix, int64_t iy, int64_t iz)
+{
+  return (uint64_t)(ix * 73856093LL) ^ (uint64_t)(iy * 19349663LL) ^ (uint64_t)(iz * 83492791LL);
+}
+
+// remove the triangles that have collapsed
+// ( the triangle ranges of the faces are updated accordingly )
+void MeshOptimizer::removeDegenerateTriangles(Mesh& mesh)
+{
+  std::vector<MeshFaceRange>& ranges = mesh.faceranges;
+  size_t nbTriangles = 0;
+  size_t face = 0;
+  for (size_t t = 0; t < mesh.triangles.size(); t++) {
+    while (face < ranges.size() && (size_t)ranges[face].firstTriangle == t) {
+      ranges[face].firstTriangle = (int)nbTriangles;
+      face++;
+    }
+    const Triangle3i tri = mesh.triangles[t];
+    if (tri.i == tri.j || tri.j == tri.k || tri.k == tri.i) {
+      continue;
+    }
+    mesh.triangles[nbTriangles++] = tri;
+  }
+  for (; face < ranges.size(); face++) {
+    ranges[face].firstTriangle = (int)nbTriangles;
+  }
+  for (face = 0; face < ranges.size(); face++) {
+    const int end = (face + 1 < ranges.size()) ? ranges[face + 1].firstTriangle : (int)nbTriangles;
+    ranges[face].nbTriangles = end - ranges[face].firstTriangle;
+  }
+  mesh.triangles.resize(nbTriangles);
+}
+
+int MeshOptimizer::weldVertices(Mesh& mesh, double tolerance, double creaseAngle)
+{
+  assert(!mesh.m_exposed);
+
+  const size_t nbVertices = mesh.vertices.size();
+  if (nbVertices == 0 || tolerance <= 0) {
+    return 0;
+  }
+  const double tolerance2 = tolerance * tolerance;
+  const double invCellSize = 1.0 / tolerance;
+  const bool   checkNormals = creaseAngle < M_PI;
+  const double cosCrease = cos(creaseAngle);
+
+  // the grid stores the welded vertices, each cell is a linked list
+  std::unordered_map<uint64_t, int> cells;
+  cells.reserve(nbVertices);
+  std::vector<int> next;            // next welded vertex in the same cell
+  std::vector<int> representative;  // original index of each welded vertex
+  std::vector<int> count;           // number of original vertices merged
+  std::vector<double> normalSum;    // sum of the merged normals
+  std::vector<int> remap(nbVertices);
+
+  next.reserve(nbVertices);
+  representative.reserve(nbVertices);
+  count.reserve(nbVertices);
+  normalSum.reserve(nbVertices * 3);
+
+  for (size_t i = 0; i < nbVertices; i++) {
+    const Coord3f& p = mesh.vertices[i];
+    const Coord3f& n = mesh.normals[i];
+
+    const int64_t ix = (int64_t)floor(p.x * invCellSize);
+    const int64_t iy = (int64_t)floor(p.y * invCellSize);
+    const int64_t iz = (int64_t)floor(p.z * invCellSize);
+
+    int found = -1;
+    for (int dx = -1; dx <= 1 && found < 0; dx++) {
+      for (int dy = -1; dy <= 1 && found < 0; dy++) {
+        for (int dz = -1; dz <= 1 && found < 0; dz++) {
+          std::unordered_map<uint64_t, int>::const_iterator it = cells.find(cellKey(ix + dx, iy + dy, iz + dz));
+          if (it == cells.end()) {
+            continue;
+          }
+          for (int w = it->second; w >= 0; w = next[w]) {
+            const int r = representative[w];
+            if (distance2(p, mesh.vertices[r]) >= tolerance2) {
+              continue;
+            }
+            if (checkNormals && dot(n, mesh.normals[r]) < cosCrease) {
+              continue;
+            }
+            found = w;
+            break;
+          }
+        }
+      }
+    }
+
+    if (found < 0) {
+      found = (int)representative.size();
+      const uint64_t key = cellKey(ix, iy, iz);
+      std::unordered_map<uint64_t, int>::iterator it = cells.find(key);
+      if (it == cells.end()) {
+        next.push_back(-1);
+        cells[key] = found;
+      } else {
+        next.push_back(it->second);
+        it->second = found;
+      }
+      representative.push_back((int)i);
+      count.push_back(1);
+      normalSum.push_back(n.x);
+      normalSum.push_back(n.y);
+      normalSum.push_back(n.z);
+    } else {
+      count[found]++;
+      normalSum[3 * found + 0] += n.x;
+      normalSum[3 * found + 1] += n.y;
+      normalSum[3 * found + 2] += n.z;
+    }
+    remap[i] = found;
+  }
+
+  const size_t nbWelded = representative.size();
+  const int nbRemoved = (int)(nbVertices - nbWelded);
+  if (nbRemoved == 0) {
+    return 0;
+  }
+
+  std::vector<Coord3f> vertices(nbWelded);
+  std::vector<Coord3f> normals(nbWelded);
+  for (size_t w = 0; w < nbWelded; w++) {
+    vertices[w] = mesh.vertices[representative[w]];
+    if (count[w] == 1) {
+      normals[w] = mesh.normals[representative[w]];
+      continue;
+    }
+    double nx = normalSum[3 * w + 0];
+    double ny = normalSum[3 * w + 1];
+    double nz = normalSum[3 * w + 2];
+    double l = sqrt(nx * nx + ny * ny + nz * nz);
+    if (l > 1.0e-10) {
+      nx /= l; ny /= l; nz /= l;
+    }
+    normals[w].x = (float)nx;
+    normals[w].y = (float)ny;
+    normals[w].z = (float)nz;
+  }
+  mesh.vertices.swap(vertices);
+  mesh.normals.swap(normals);
+
+  // remap triangles, the ones that collapse are removed
+  for (size_t t = 0; t < mesh.triangles.size(); t++) {
+    Triangle3i& tri = mesh.triangles[t];
+    tri.i = remap[tri.i];
+    tri.j = remap[tri.j];
+    tri.k = remap[tri.k];
+  }
+  removeDegenerateTriangles(mesh);
+
+  for (size_t e = 0; e < mesh.edgeindices.size(); e++) {
+    mesh.edgeindices[e] = remap[mesh.edgeindices[e]];
+  }
+
+  mesh.m_statistics.nbWeldedVertices += nbRemoved;
+  return nbRemoved;
+}
+
+
+//
+// quadric error metric simplification
+// see : Garland & Heckbert, Surface Simplification Using Quadric Error Metrics
+//
+// the symmetric 4x4 matrix of a quadric is stored as its upper triangle :
+//  a2 ab ac ad
+//     b2 bc bd
+//        c2 cd
+//           d2
+struct Quadric {
+  double m[10];
+};
+
+static void addPlane(Quadric& q, double a, double b, double c, double d)
+{
+  q.m[0] += a * a; q.m[1] += a * b; q.m[2] += a * c; q.m[3] += a * d;
+  q.m[4] += b * b; q.m[5] += b * c; q.m[6] += b * d;
+  q.m[7] += c * c; q.m[8] += c * d;
+  q.m[9] += d * d;
+}
+
+static void addQuadric(Quadric& q, const Quadric& other)
+{
+  for (int i = 0; i < 10; i++) {
+    q.m[i] += other.m[i];
+  }
+}
+
+// sum of the squared distances of p to the planes of the quadric
+static double quadricError(const Quadric& q, const Coord3f& p)
+{
+  const double x = p.x, y = p.y, z = p.z;
+  const double e =
+      q.m[0] * x * x + 2 * q.m[1] * x * y + 2 * q.m[2] * x * z + 2 * q.m[3] * x
+    + q.m[4] * y * y + 2 * q.m[5] * y * z + 2 * q.m[6] * y
+    + q.m[7] * z * z + 2 * q.m[8] * z
+    + q.m[9];
+  return e > 0 ? e : 0;
+}
+
+static void triangleNormal(const Coord3f& p0, const Coord3f& p1, const Coord3f& p2, double n[3])
+{
+  const double ux = p1.x - p0.x, uy = p1.y - p0.y, uz = p1.z - p0.z;
+  const double vx = p2.x - p0.x, vy = p2.y - p0.y, vz = p2.z - p0.z;
+  n[0] = uy * vz - uz * vy;
+  n[1] = uz * vx - ux * vz;
+  n[2] = ux * vy - uy * vx;
+}
+
+// collapse of the vertex source onto the vertex target
+struct Collapse {
+  int source;
+  int target;
+  double error;
+};
+
+static bool operator < (const Collapse& a, const Collapse& b)
+{
+  return a.error < b.error;
+}
+
+static inline uint64_t edgeKey(int a, int b)
+{
+  return a < b ? ((uint64_t)a << 32) | (uint32_t)b : ((uint64_t)b << 32) | (uint32_t)a;
+}
+
+// distance from p to the plane of a triangle of normal n ( not normalized )
+static inline double planeDistance(const Coord3f& p, const Coord3f& origin, const double n[3], double length)
+{
+  return fabs(n[0] * (p.x - origin.x) + n[1] * (p.y - origin.y) + n[2] * (p.z - origin.z)) / length;
+}
+
+static inline void addRingVertices(const Triangle3i& tri, int v, std::vector<int>& ring)
+{
+  if (tri.i != v) ring.push_back(tri.i);
+  if (tri.j != v) ring.push_back(tri.j);
+  if (tri.k != v) ring.push_back(tri.k);
+}
+
+// the link condition ( Dey et al. ) : the vertices adjacent to both s and d must
+// be the opposite vertices of the triangles of the edge s-d, otherwise the
+// collapse would pinch the surface into a non manifold one
+static bool checkLinkCondition(const std::vector<Triangle3i>& triangles, const std::vector<int>& adjacencyStart,
+                               const std::vector<int>& adjacency, int s, int d,
+                               std::vector<int>& ringS, std::vector<int>& ringD, std::vector<int>& opposite)
+{
+  ringS.clear();
+  ringD.clear();
+  opposite.clear();
+  for (int a = adjacencyStart[s]; a < adjacencyStart[s + 1]; a++) {
+    const Triangle3i& tri = triangles[adjacency[a]];
+    if (tri.i == d || tri.j == d || tri.k == d) {
+      opposite.push_back(tri.i != s && tri.i != d ? tri.i : (tri.j != s && tri.j != d ? tri.j : tri.k));
+    }
+    addRingVertices(tri, s, ringS);
+  }
+  for (int a = adjacencyStart[d]; a < adjacencyStart[d + 1]; a++) {
+    addRingVertices(triangles[adjacency[a]], d, ringD);
+  }
+  std::sort(ringS.begin(), ringS.end());
+  ringS.erase(std::unique(ringS.begin(), ringS.end()), ringS.end());
+  std::sort(ringD.begin(), ringD.end());
+  ringD.erase(std::unique(ringD.begin(), ringD.end()), ringD.end());
+  std::sort(opposite.begin(), opposite.end());
+
+  std::vector<int>::const_iterator itS = ringS.begin();
+  std::vector<int>::const_iterator itD = ringD.begin();
+  while (itS != ringS.end() && itD != ringD.end()) {
+    if (*itS < *itD) {
+      ++itS;
+    } else if (*itD < *itS) {
+      ++itD;
+    } else {
+      if (*itS != d && !std::binary_search(opposite.begin(), opposite.end(), *itS)) {
+        return false;
+      }
+      ++itS;
+      ++itD;
+    }
+  }
+  return true;
+}
+
+int MeshOptimizer::decimate(Mesh& mesh, size_t targetTriangles, double maxError)
+{
+  assert(!mesh.m_exposed);
+
+  const size_t nbVertices = mesh.vertices.size();
+  const size_t nbInitialTriangles = mesh.triangles.size();
+  if (nbInitialTriangles <= targetTriangles || (targetTriangles == 0 && maxError <= 0)) {
+    return 0;
+  }
+  const double maxDistance = maxError > 0 ? maxError : std::numeric_limits<double>::max();
+  std::vector<Triangle3i>& triangles = mesh.triangles;
+
+  // quadric of the planes of the triangles around each vertex
+  std::vector<Quadric> quadrics(nbVertices);
+  memset(&quadrics[0], 0, nbVertices * sizeof(Quadric));
+  for (size_t t = 0; t < triangles.size(); t++) {
+    const Triangle3i& tri = triangles[t];
+    double n[3];
+    triangleNormal(mesh.vertices[tri.i], mesh.vertices[tri.j], mesh.vertices[tri.k], n);
+    const double l = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (l < 1.0e-20) {
+      continue;
+    }
+    n[0] /= l; n[1] /= l; n[2] /= l;
+    const Coord3f& p = mesh.vertices[tri.i];
+    const double d = -(n[0] * p.x + n[1] * p.y + n[2] * p.z);
+    const int v[3] = { tri.i, tri.j, tri.k };
+    for (int c = 0; c < 3; c++) {
+      addPlane(quadrics[v[c]], n[0], n[1], n[2], d);
+    }
+  }
+
+  // the vertices of the edges and of the open borders of the faces are locked
+  std::vector<char> locked(nbVertices, 0);
+  for (size_t e = 0; e < mesh.edgeindices.size(); e++) {
+    locked[mesh.edgeindices[e]] = 1;
+  }
+  {
+    std::unordered_map<uint64_t, int> edgeCount;
+    edgeCount.reserve(triangles.size() * 3);
+    for (size_t t = 0; t < triangles.size(); t++) {
+      const Triangle3i& tri = triangles[t];
+      edgeCount[edgeKey(tri.i, tri.j)]++;
+      edgeCount[edgeKey(tri.j, tri.k)]++;
+      edgeCount[edgeKey(tri.k, tri.i)]++;
+    }
+    for (std::unordered_map<uint64_t, int>::const_iterator it = edgeCount.begin(); it != edgeCount.end(); ++it) {
+      if (it->second != 2) {
+        locked[(int)(it->first >> 32)] = 1;
+        locked[(int)(it->first & 0xFFFFFFFF)] = 1;
+      }
+    }
+  }
+
+  // upper bound of the distance between the decimated surface around each
+  // vertex and the initial surface, accumulated over the collapses
+  std::vector<double> deviation(nbVertices, 0.0);
+
+  std::vector<int> adjacencyStart(nbVertices + 1);
+  std::vector<int> adjacency;
+  std::vector<char> touched(nbVertices);
+  std::vector<int> ringS, ringD, opposite;
+  std::vector<Collapse> collapses;
+  size_t nbTriangles = triangles.size();
+
+  // each pass applies a batch of independent collapses, cheapest first
+  for (;;) {
+    // triangles around each vertex
+    std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+    for (size_t t = 0; t < triangles.size(); t++) {
+      adjacencyStart[triangles[t].i + 1]++;
+      adjacencyStart[triangles[t].j + 1]++;
+      adjacencyStart[triangles[t].k + 1]++;
+    }
+    for (size_t v = 0; v < nbVertices; v++) {
+      adjacencyStart[v + 1] += adjacencyStart[v];
+    }
+    adjacency.resize(triangles.size() * 3);
+    {
+      std::vector<int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+      for (size_t t = 0; t < triangles.size(); t++) {
+        adjacency[fill[triangles[t].i]++] = (int)t;
+        adjacency[fill[triangles[t].j]++] = (int)t;
+        adjacency[fill[triangles[t].k]++] = (int)t;
+      }
+    }
+
+    collapses.clear();
+    for (size_t t = 0; t < triangles.size(); t++) {
+      const int v[3] = { triangles[t].i, triangles[t].j, triangles[t].k };
+      for (int c = 0; c < 3; c++) {
+        const int a = v[c];
+        const int b = v[(c + 1) % 3];
+        if (!locked[a]) {
+          Quadric q = quadrics[a];
+          addQuadric(q, quadrics[b]);
+          Collapse collapse = { a, b, quadricError(q, mesh.vertices[b]) };
+          collapses.push_back(collapse);
+        }
+        if (!locked[b]) {
+          Quadric q = quadrics[b];
+          addQuadric(q, quadrics[a]);
+          Collapse collapse = { b, a, quadricError(q, mesh.vertices[a]) };
+          collapses.push_back(collapse);
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end());
+
+    std::fill(touched.begin(), touched.end(), 0);
+    size_t nbApplied = 0;
+    for (size_t c = 0; c < collapses.size() && nbTriangles > targetTriangles; c++) {
+      const Collapse& collapse = collapses[c];
+      const int s = collapse.source;
+      const int d = collapse.target;
+      if (touched[s] || touched[d]) {
+        continue;
+      }
+      if (!checkLinkCondition(triangles, adjacencyStart, adjacency, s, d, ringS, ringD, opposite)) {
+        continue;
+      }
+
+      // reject the collapse if a remaining triangle would flip or degenerate,
+      // and measure how far the moved triangles go from the current surface :
+      // d against the planes of the triangles around s, s against the moved ones
+      bool flips = false;
+      double distance = 0.0;
+      for (int a = adjacencyStart[s]; a < adjacencyStart[s + 1] && !flips; a++) {
+        const Triangle3i& tri = triangles[adjacency[a]];
+        if (tri.i == d || tri.j == d || tri.k == d) {
+          continue;
+        }
+        const Coord3f& p0 = mesh.vertices[tri.i == s ? d : tri.i];
+        const Coord3f& p1 = mesh.vertices[tri.j == s ? d : tri.j];
+        const Coord3f& p2 = mesh.vertices[tri.k == s ? d : tri.k];
+        double before[3], after[3];
+        triangleNormal(mesh.vertices[tri.i], mesh.vertices[tri.j], mesh.vertices[tri.k], before);
+        triangleNormal(p0, p1, p2, after);
+        const double lBefore = sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]);
+        const double lAfter = sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+        if (lBefore < 1.0e-20) {
+          continue;
+        }
+        if (lAfter < 1.0e-20) {
+          flips = true;
+          break;
+        }
+        // more than ~78 degrees between the normals is considered a flip
+        flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] < 0.2 * lBefore * lAfter;
+        const Coord3f& origin = mesh.vertices[tri.i];
+        distance = std::max(distance, planeDistance(mesh.vertices[d], origin, before, lBefore));
+        distance = std::max(distance, planeDistance(mesh.vertices[s], p0, after, lAfter));
+      }
+      if (flips) {
+        continue;
+      }
+      const double newDeviation = std::max(deviation[d], deviation[s] + distance);
+      if (newDeviation > maxDistance) {
+        continue;
+      }
+
+      // the ring of s is locked for the rest of the pass so that
+      // the adjacency of the remaining candidates stays valid
+      for (int a = adjacencyStart[s]; a < adjacencyStart[s + 1]; a++) {
+        Triangle3i& tri = triangles[adjacency[a]];
+        touched[tri.i] = touched[tri.j] = touched[tri.k] = 1;
+        if (tri.i == d || tri.j == d || tri.k == d) {
+          nbTriangles--;
+        }
+        if (tri.i == s) tri.i = d;
+        if (tri.j == s) tri.j = d;
+        if (tri.k == s) tri.k = d;
+      }
+      addQuadric(quadrics[d], quadrics[s]);
+      // the triangles that moved also belong to the other vertices of the ring
+      for (size_t r = 0; r < ringS.size(); r++) {
+        deviation[ringS[r]] = std::max(deviation[ringS[r]], newDeviation);
+      }
+      nbApplied++;
+    }
+    if (nbApplied == 0) {
+      break;
+    }
+    removeDegenerateTriangles(mesh);
+    if (nbTriangles <= targetTriangles) {
+      break;
+    }
+  }
+
+  // drop the vertices that are no longer referenced
+  // ( edge vertices are locked so they are always kept )
+  std::vector<int> remap(nbVertices, -1);
+  for (size_t t = 0; t < triangles.size(); t++) {
+    remap[triangles[t].i] = remap[triangles[t].j] = remap[triangles[t].k] = 0;
+  }
+  for (size_t e = 0; e < mesh.edgeindices.size(); e++) {
+    remap[mesh.edgeindices[e]] = 0;
+  }
+  size_t nbKept = 0;
+  for (size_t v = 0; v < nbVertices; v++) {
+    if (remap[v] < 0) {
+      continue;
+    }
+    remap[v] = (int)nbKept;
+    mesh.vertices[nbKept] = mesh.vertices[v];
+    mesh.normals[nbKept] = mesh.normals[v];
+    nbKept++;
+  }
+  mesh.vertices.resize(nbKept);
+  mesh.normals.resize(nbKept);
+  for (size_t t = 0; t < triangles.size(); t++) {
+    Triangle3i& tri = triangles[t];
+    tri.i = remap[tri.i];
+    tri.j = remap[tri.j];
+    tri.k = remap[tri.k];
+  }
+  for (size_t e = 0; e < mesh.edgeindices.size(); e++) {
+    mesh.edgeindices[e] = remap[mesh.edgeindices[e]];
+  }
+
+  const int nbRemoved = (int)(nbInitialTriangles - triangles.size());
+  mesh.m_statistics.nbDecimatedTriangles += nbRemoved;
+  return nbRemoved;
+}
+
+
+//
+// Forsyth's vertex cache optimisation
+// see : https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+//
+static const int kCacheSize = 32;
+
+static float vertexScore(int cachePosition, int nbRemainingTriangles)
+{
+  if (nbRemainingTriangles == 0) {
+    return -1.0f;  // no triangle needs this vertex anymore
+  }
+  float score = 0.0f;
+  if (cachePosition >= 0) {
+    if (cachePosition < 3) {
+      // the vertices of the last triangle get a fixed score
+      score = 0.75f;
+    } else {
+      const float scaler = 1.0f / (kCacheSize - 3);
+      score = powf(1.0f - (cachePosition - 3) * scaler, 1.5f);
+    }
+  }
+  // boost the vertices that only have a few triangles left
+  score += 2.0f * powf((float)nbRemainingTriangles, -0.5f);
+  return score;
+}
+
+struct TriangleCluster {
+  size_t start;
+  size_t end;
+  double sortKey;
+};
+
+static bool operator < (const TriangleCluster& a, const TriangleCluster& b)
+{
+  return a.sortKey > b.sortKey;
+}
+
+// centroid of the vertices of the mesh
+static void meshCentroid(const std::vector<Coord3f>& v, double center[3])
+{
+  double cx = 0, cy = 0, cz = 0;
+  for (size_t i = 0; i < v.size(); i++) {
+    cx += v[i].x; cy += v[i].y; cz += v[i].z;
+  }
+  if (!v.empty()) {
+    cx /= v.size(); cy /= v.size(); cz /= v.size();
+  }
+  center[0] = cx;
+  center[1] = cy;
+  center[2] = cz;
+}
+
+// sort the clusters of triangles, the clusters facing away from center first
+static void sortClusters(const std::vector<Coord3f>& v, const double center[3],
+                         std::vector<Triangle3i>& triangles, const std::vector<size_t>& clusterStarts)
+{
+  const double cx = center[0], cy = center[1], cz = center[2];
+
+  std::vector<TriangleCluster> clusters(clusterStarts.size());
+  for (size_t c = 0; c < clusterStarts.size(); c++) {
+    TriangleCluster& cluster = clusters[c];
+    cluster.start = clusterStarts[c];
+    cluster.end = (c + 1 < clusterStarts.size()) ? clusterStarts[c + 1] : triangles.size();
+
+    // area weighted centroid and normal of the cluster
+    double px = 0, py = 0, pz = 0, nx = 0, ny = 0, nz = 0, area = 0;
+    for (size_t t = cluster.start; t < cluster.end; t++) {
+      const Coord3f& a = v[triangles[t].i];
+      const Coord3f& b = v[triangles[t].j];
+      const Coord3f& d = v[triangles[t].k];
+      double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+      double wx = d.x - a.x, wy = d.y - a.y, wz = d.z - a.z;
+      double tx = uy * wz - uz * wy;
+      double ty = uz * wx - ux * wz;
+      double tz = ux * wy - uy * wx;
+      double l = sqrt(tx * tx + ty * ty + tz * tz);
+      px += (a.x + b.x + d.x) / 3.0 * l;
+      py += (a.y + b.y + d.y) / 3.0 * l;
+      pz += (a.z + b.z + d.z) / 3.0 * l;
+      nx += tx; ny += ty; nz += tz;
+      area += l;
+    }
+    double nl = sqrt(nx * nx + ny * ny + nz * nz);
+    if (area > 0 && nl > 0) {
+      px /= area; py /= area; pz /= area;
+      cluster.sortKey = ((px - cx) * nx + (py - cy) * ny + (pz - cz) * nz) / nl;
+    } else {
+      cluster.sortKey = 0;
+    }
+  }
+  std::stable_sort(clusters.begin(), clusters.end());
+
+  std::vector<Triangle3i> sorted;
+  sorted.reserve(triangles.size());
+  for (size_t c = 0; c < clusters.size(); c++) {
+    sorted.insert(sorted.end(), triangles.begin() + clusters[c].start, triangles.begin() + clusters[c].end);
+  }
+  triangles.swap(sorted);
+}
+
+// reorder triangles whose vertex indices are in [0, nbVertices)
+static void reorderTriangles(std::vector<Triangle3i>& triangles, size_t nbVertices, std::vector<size_t>& clusterStarts)
+{
+  const size_t nbTriangles = triangles.size();
+  if (nbTriangles == 0) {
+    return;
+  }
+
+  // triangles adjacent to each vertex ( compressed rows )
+  std::vector<int> nbRemaining(nbVertices, 0);
+  for (size_t t = 0; t < nbTriangles; t++) {
+    nbRemaining[triangles[t].i]++;
+    nbRemaining[triangles[t].j]++;
+    nbRemaining[triangles[t].k]++;
+  }
+  std::vector<size_t> offsets(nbVertices + 1, 0);
+  for (size_t v = 0; v < nbVertices; v++) {
+    offsets[v + 1] = offsets[v] + nbRemaining[v];
+  }
+  std::vector<int> adjacency(offsets[nbVertices]);
+  {
+    std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < nbTriangles; t++) {
+      adjacency[fill[triangles[t].i]++] = (int)t;
+      adjacency[fill[triangles[t].j]++] = (int)t;
+      adjacency[fill[triangles[t].k]++] = (int)t;
+    }
+  }
+
+  std::vector<int> cachePosition(nbVertices, -1);
+  std::vector<float> vScore(nbVertices);
+  for (size_t v = 0; v < nbVertices; v++) {
+    vScore[v] = vertexScore(-1, nbRemaining[v]);
+  }
+  std::vector<float> tScore(nbTriangles);
+  std::vector<char> emitted(nbTriangles, 0);
+  int best = 0;
+  for (size_t t = 0; t < nbTriangles; t++) {
+    tScore[t] = vScore[triangles[t].i] + vScore[triangles[t].j] + vScore[triangles[t].k];
+    if (tScore[t] > tScore[best]) {
+      best = (int)t;
+    }
+  }
+
+  std::vector<Triangle3i> result;
+  result.reserve(nbTriangles);
+
+  std::vector<int> cache;
+  std::vector<int> newCache;
+  cache.reserve(kCacheSize + 3);
+  newCache.reserve(kCacheSize + 3);
+  size_t cursor = 0;
+
+  while (result.size() < nbTriangles) {
+
+    if (best < 0) {
+      // nothing in the cache is usable : take the next triangle in input order
+      while (cursor < nbTriangles && emitted[cursor]) {
+        cursor++;
+      }
+      if (cursor == nbTriangles) {
+        break;
+      }
+      best = (int)cursor;
+    }
+
+    const Triangle3i tri = triangles[best];
+    const int tv[3] = { tri.i, tri.j, tri.k };
+
+    // a triangle that misses all its vertices starts a new cluster
+    if (cachePosition[tv[0]] < 0 && cachePosition[tv[1]] < 0 && cachePosition[tv[2]] < 0) {
+      clusterStarts.push_back(result.size());
+    }
+    result.push_back(tri);
+    emitted[best] = 1;
+
+    // remove the triangle from the active list of its vertices
+    for (int k = 0; k < 3; k++) {
+      const int v = tv[k];
+      int* list = &adjacency[offsets[v]];
+      const int last = nbRemaining[v] - 1;
+      for (int j = 0; j <= last; j++) {
+        if (list[j] == best) {
+          std::swap(list[j], list[last]);
+          nbRemaining[v]--;
+          break;
+        }
+      }
+    }
+
+    // the vertices of the triangle move to the front of the LRU cache
+    newCache.clear();
+    newCache.push_back(tv[0]);
+    newCache.push_back(tv[1]);
+    newCache.push_back(tv[2]);
+    for (size_t c = 0; c < cache.size(); c++) {
+      const int v = cache[c];
+      if (v != tv[0] && v != tv[1] && v != tv[2]) {
+        newCache.push_back(v);
+      }
+    }
+
+    for (size_t c = 0; c < newCache.size(); c++) {
+      const int v = newCache[c];
+      cachePosition[v] = c < (size_t)kCacheSize ? (int)c : -1;
+      vScore[v] = vertexScore(cachePosition[v], nbRemaining[v]);
+    }
+
+    // update the scores of the triangles touched by the cache and pick the best one
+    best = -1;
+    float bestScore = -1.0f;
+    for (size_t c = 0; c < newCache.size(); c++) {
+      const int v = newCache[c];
+      const int* list = &adjacency[offsets[v]];
+      for (int j = 0; j < nbRemaining[v]; j++) {
+        const int t = list[j];
+        const Triangle3i& o = triangles[t];
+        tScore[t] = vScore[o.i] + vScore[o.j] + vScore[o.k];
+        if (cachePosition[v] >= 0 && tScore[t] > bestScore) {
+          bestScore = tScore[t];
+          best = t;
+        }
+      }
+    }
+
+    if (newCache.size() > (size_t)kCacheSize) {
+      newCache.resize(kCacheSize);
+    }
+    cache.swap(newCache);
+  }
+
+  triangles.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexCache(Mesh& mesh, bool overdraw)
+{
+  assert(!mesh.m_exposed);
+
+  if (mesh.triangles.empty()) {
+    return;
+  }
+
+  // the triangles are reordered face by face so that the
+  // triangle ranges of the faces remain valid
+  std::vector<MeshFaceRange> ranges = mesh.faceranges;
+  if (ranges.empty()) {
+    MeshFaceRange all = { 0, 0, (int)mesh.triangles.size(), 0, (int)mesh.vertices.size() };
+    ranges.push_back(all);
+  }
+
+  std::vector<int> localIndex(mesh.vertices.size(), -1);
+  std::vector<int> globalIndex;
+  std::vector<Triangle3i> local;
+  std::vector<size_t> clusterStarts;
+
+  // the clusters of all the faces are sorted against the same point
+  double center[3] = { 0, 0, 0 };
+  if (overdraw) {
+    meshCentroid(mesh.vertices, center);
+  }
+
+  for (size_t f = 0; f < ranges.size(); f++) {
+    const MeshFaceRange& range = ranges[f];
+    Triangle3i* triangles = mesh.triangles.data() + range.firstTriangle;
+
+    // compact the vertex indices of the face
+    local.resize(range.nbTriangles);
+    globalIndex.clear();
+    for (int t = 0; t < range.nbTriangles; t++) {
+      int* src = &triangles[t].i;
+      int* dst = &local[t].i;
+      for (int k = 0; k < 3; k++) {
+        if (localIndex[src[k]] < 0) {
+          localIndex[src[k]] = (int)globalIndex.size();
+          globalIndex.push_back(src[k]);
+        }
+        dst[k] = localIndex[src[k]];
+      }
+    }
+
+    clusterStarts.clear();
+    reorderTriangles(local, globalIndex.size(), clusterStarts);
+
+    for (int t = 0; t < range.nbTriangles; t++) {
+      local[t].i = globalIndex[local[t].i];
+      local[t].j = globalIndex[local[t].j];
+      local[t].k = globalIndex[local[t].k];
+    }
+    if (overdraw && clusterStarts.size() > 1) {
+      sortClusters(mesh.vertices, center, local, clusterStarts);
+    }
+    std::copy(local.begin(), local.end(), triangles);
+
+    for (size_t v = 0; v < globalIndex.size(); v++) {
+      localIndex[globalIndex[v]] = -1;
+    }
+  }
+}
+
+void MeshOptimizer::optimizeVertexFetch(Mesh& mesh)
+{
+  assert(!mesh.m_exposed);
+
+  const size_t nbVertices = mesh.vertices.size();
+  std::vector<int> remap(nbVertices, -1);
+  int next = 0;
+  for (size_t t = 0; t < mesh.triangles.size(); t++) {
+    Triangle3i& tri = mesh.triangles[t];
+    if (remap[tri.i] < 0) remap[tri.i] = next++;
+    if (remap[tri.j] < 0) remap[tri.j] = next++;
+    if (remap[tri.k] < 0) remap[tri.k] = next++;
+    tri.i = remap[tri.i];
+    tri.j = remap[tri.j];
+    tri.k = remap[tri.k];
+  }
+  // vertices that are not used by any triangle are kept at the end
+  for (size_t v = 0; v < nbVertices; v++) {
+    if (remap[v] < 0) remap[v] = next++;
+  }
+
+  std::vector<Coord3f> vertices(nbVertices);
+  std::vector<Coord3f> normals(nbVertices);
+  for (size_t v = 0; v < nbVertices; v++) {
+    vertices[remap[v]] = mesh.vertices[v];
+    normals[remap[v]] = mesh.normals[v];
+  }
+  mesh.vertices.swap(vertices);
+  mesh.normals.swap(normals);
+
+  for (size_t e = 0; e < mesh.edgeindices.size(); e++) {
+    mesh.edgeindices[e] = remap[mesh.edgeindices[e]];
+  }
+}
+
+double MeshOptimizer::computeACMR(const Mesh& mesh, int cacheSize)
+{
+  const size_t nbTriangles = mesh.triangles.size();
+  if (nbTriangles == 0) {
+    return 0.0;
+  }
+  // FIFO cache : a vertex is in the cache if it has been loaded
+  // less than cacheSize misses ago
+  std::vector<size_t> timestamp(mesh.vertices.size(), 0);
+  size_t time = cacheSize + 1;
+  size_t misses = 0;
+  for (size_t t = 0; t < nbTriangles; t++) {
+    const int tv[3] = { mesh.triangles[t].i, mesh.triangles[t].j, mesh.triangles[t].k };
+    for (int k = 0; k < 3; k++) {
+      if (time - timestamp[tv[k]] > (size_t)cacheSize) {
+        timestamp[tv[k]] = time++;
+        misses++;
+      }
+    }
+  }
+  return double(misses) / double(nbTriangles);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "Mesh.h"
+
+//
+// optimization passes that work on the native buffers of a mesh
+// ( must be called before the javascript typed arrays are created )
+//
+class MeshOptimizer {
+public:
+  // merge the vertices that are closer than tolerance.
+  // vertices whose normals differ by more than creaseAngle (radians)
+  // are kept split so that sharp edges remain sharp.
+  // returns the number of vertices that have been removed
+  static int weldVertices(Mesh& mesh, double tolerance, double creaseAngle);
+
+  // reorder the triangles to improve the post-transform vertex cache hit rate
+  // ( Forsyth's linear-speed vertex cache optimisation ).
+  // when overdraw is true, the resulting clusters of triangles are then sorted
+  // so that the outward-facing ones are drawn first.
+  // the triangles never move from one face range to another.
+  static void optimizeVertexCache(Mesh& mesh, bool overdraw);
+
+  // simplify the mesh by collapsing edges in the order of their quadric error
+  // ( Garland-Heckbert ) until the mesh has no more than targetTriangles
+  // triangles or no collapse is left that keeps the surface within maxError
+  // ( model units ) of the initial one.
+  // a collapse is rejected when it breaks the link condition ( the surface
+  // would become non manifold ) or when it flips or flattens a triangle.
+  // targetTriangles = 0 means no target, maxError <= 0 means no error limit.
+  // the vertices of the edges and of the borders of the faces never move, so
+  // the outline of every face is preserved and triangles stay in their face range.
+  // returns the number of triangles that have been removed
+  static int decimate(Mesh& mesh, size_t targetTriangles, double maxError);
+
+  // renumber the vertices in the order in which the triangles fetch them
+  static void optimizeVertexFetch(Mesh& mesh);
+
+  // average cache miss ratio (misses per triangle) of a FIFO cache
+  static double computeACMR(const Mesh& mesh, int cacheSize = 16);
+
+private:
+  // remove the triangles that have two identical vertices
+  static void removeDegenerateTriangles(Mesh& mesh);
+};
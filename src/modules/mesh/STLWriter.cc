@@ -0,0 +1,157 @@
+#include "STLWriter.h"
+
+#include <uv.h>
+#include <algorithm>
+#include <string.h>
+
+static const size_t kHeaderSize   = 80;
+static const size_t kTriangleSize = 50; // normal, 3 vertices ( 12 floats ) and the attribute byte count
+
+static void writeUint32(std::ostream& out, unsigned int value)
+{
+  // STL is little endian whatever the platform
+  const char bytes[4] = {
+    (char)(value & 0xFF), (char)((value >> 8) & 0xFF),
+    (char)((value >> 16) & 0xFF), (char)((value >> 24) & 0xFF)
+  };
+  out.write(bytes, 4);
+}
+
+static size_t faceTriangleCount(const TopoDS_Face& face)
+{
+  TopLoc_Location loc;
+  occHandle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
+  return triangulation.IsNull() ? 0 : (size_t)triangulation->NbTriangles();
+}
+
+// serialize the triangles of a face at dest ( faceTriangleCount(face) * kTriangleSize bytes )
+static void serializeFace(const TopoDS_Face& face, char* dest)
+{
+  TopLoc_Location loc;
+  occHandle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
+  if (triangulation.IsNull()) {
+    return;
+  }
+  const gp_Trsf tr = loc;
+  const bool reversed = face.Orientation() == TopAbs_REVERSED;
+  const TColgp_Array1OfPnt& nodes = triangulation->Nodes();
+  const Poly_Array1OfTriangle& triangles = triangulation->Triangles();
+
+  for (int i = 1; i <= triangulation->NbTriangles(); i++) {
+    Standard_Integer n1, n2, n3;
+    if (reversed) {
+      triangles(i).Get(n2, n1, n3);
+    } else {
+      triangles(i).Get(n1, n2, n3);
+    }
+    const gp_Pnt p1 = nodes(n1).Transformed(tr);
+    const gp_Pnt p2 = nodes(n2).Transformed(tr);
+    const gp_Pnt p3 = nodes(n3).Transformed(tr);
+
+    gp_Vec normal = gp_Vec(p1, p2).Crossed(gp_Vec(p1, p3));
+    if (normal.SquareMagnitude() > 1.0e-20) {
+      normal.Normalize();
+    } else {
+      normal = gp_Vec(0.0, 0.0, 0.0); // degenerated triangle
+    }
+
+    const float values[12] = {
+      (float)normal.X(), (float)normal.Y(), (float)normal.Z(),
+      (float)p1.X(), (float)p1.Y(), (float)p1.Z(),
+      (float)p2.X(), (float)p2.Y(), (float)p2.Z(),
+      (float)p3.X(), (float)p3.Y(), (float)p3.Z()
+    };
+    // the floats are written in the byte order of the platform ( little endian for node )
+    memcpy(dest, values, sizeof(values));
+    dest[48] = 0;
+    dest[49] = 0;
+    dest += kTriangleSize;
+  }
+}
+
+//
+// faces [firstFace, lastFace) of a batch, each thread picks the
+// next face and serializes it at its offset in the batch buffer.
+//
+struct STLBatchJob {
+  const std::vector<TopoDS_Face>* faces;
+  const std::vector<size_t>* offsets; // byte offset of each face in the file body
+  size_t firstFace;
+  size_t lastFace;
+  char*  buffer;                      // holds the bytes of the faces of the batch
+
+  uv_mutex_t mutex;
+  size_t nextFace;
+};
+
+static void serializeFaceWorker(void* arg)
+{
+  STLBatchJob* job = static_cast<STLBatchJob*>(arg);
+  const size_t batchOffset = (*job->offsets)[job->firstFace];
+  for (;;) {
+    size_t i;
+    uv_mutex_lock(&job->mutex);
+    i = job->nextFace++;
+    uv_mutex_unlock(&job->mutex);
+    if (i >= job->lastFace) {
+      break;
+    }
+    serializeFace((*job->faces)[i], job->buffer + (*job->offsets)[i] - batchOffset);
+  }
+}
+
+size_t writeBinarySTL(std::ostream& out, const std::vector<TopoDS_Face>& faces,
+                      const STLWriterOptions& options, MeshProgressListener* listener)
+{
+  const size_t nbFaces = faces.size();
+
+  // the prefix sums of the triangle counts give the place of each face
+  std::vector<size_t> offsets(nbFaces + 1, 0);
+  for (size_t i = 0; i < nbFaces; i++) {
+    offsets[i + 1] = offsets[i] + faceTriangleCount(faces[i]) * kTriangleSize;
+  }
+  const size_t nbTriangles = offsets[nbFaces] / kTriangleSize;
+
+  char header[kHeaderSize];
+  memset(header, ' ', kHeaderSize);
+  const char title[] = "binary STL written by node-occ";
+  memcpy(header, title, sizeof(title) - 1);
+  out.write(header, kHeaderSize);
+  writeUint32(out, (unsigned int)nbTriangles);
+
+  const size_t batchBytes = std::max(options.bufferTriangles, (size_t)1) * kTriangleSize;
+  std::vector<char> buffer;
+  const size_t maxThreads = options.parallel ? (size_t)numberOfThreads() : 1;
+
+  size_t firstFace = 0;
+  while (firstFace < nbFaces && out) {
+    // a batch holds whole faces, a face larger than the buffer is a batch of its own
+    size_t lastFace = firstFace + 1;
+    while (lastFace < nbFaces && offsets[lastFace + 1] - offsets[firstFace] <= batchBytes) {
+      lastFace++;
+    }
+    const size_t byteLength = offsets[lastFace] - offsets[firstFace];
+    if (buffer.size() < byteLength) {
+      buffer.resize(byteLength);
+    }
+
+    STLBatchJob job;
+    job.faces = &faces;
+    job.offsets = &offsets;
+    job.firstFace = firstFace;
+    job.lastFace = lastFace;
+    job.buffer = buffer.data();
+    job.nextFace = firstFace;
+    uv_mutex_init(&job.mutex);
+
+    runInParallel(serializeFaceWorker, &job, std::min(maxThreads, lastFace - firstFace));
+    uv_mutex_destroy(&job.mutex);
+
+    out.write(buffer.data(), byteLength);
+    if (listener) {
+      listener->onFaceExtracted(lastFace, nbFaces);
+    }
+    firstFace = lastFace;
+  }
+  return nbTriangles;
+}
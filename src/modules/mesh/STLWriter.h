@@ -0,0 +1,28 @@
+#pragma once
+#include "OCC.h"
+#include "MeshExtractor.h"
+
+#include <ostream>
+#include <vector>
+
+struct STLWriterOptions {
+  STLWriterOptions() : bufferTriangles(65536), parallel(false) {}
+  size_t bufferTriangles; // size of a batch
+  bool   parallel;        // serialize the faces of a batch in a pool of threads
+};
+
+//
+// binary STL serialization of the triangulation already attached to faces
+// ( nothing is meshed again, faces without triangulation are skipped ).
+//
+// the triangles are written in batches of about bufferTriangles triangles :
+// the offset of each face in a batch is known from its number of triangles,
+// so in parallel mode the faces of a batch are serialized concurrently by a
+// pool of threads directly at their place in the batch buffer.
+// the output is the same in serial and in parallel mode.
+//
+// returns the number of triangles written, the caller checks the state of the stream.
+// Note: this function doesn't use V8 and can be called from a worker thread.
+//
+size_t writeBinarySTL(std::ostream& out, const std::vector<TopoDS_Face>& faces,
+                      const STLWriterOptions& options, MeshProgressListener* listener = 0);
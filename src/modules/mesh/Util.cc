@@ -52,6 +52,16 @@ double ReadDouble(v8::Handle<v8::Object> value, const char* name, double default
   return defaultValue;
 }
 
+bool ReadBool(v8::Handle<v8::Object> value, const char* name, bool defaultValue)
+{
+  Nan::EscapableHandleScope scope;
+  v8::Local<v8::Value> _v = value->ToObject()->Get(Nan::New(name).ToLocalChecked());
+  if (_v->IsUndefined()) {
+    return defaultValue;
+  }
+  return _v->BooleanValue();
+}
+
 int ReadInt(v8::Handle<v8::Object> value, const char* name, int defaultValue)
 {
   Nan::EscapableHandleScope scope;
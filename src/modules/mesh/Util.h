@@ -6,6 +6,7 @@ void ReadDouble(const v8::Handle<v8::Value>& _v,double& value);
 
 int ReadInt(v8::Handle<v8::Object> obj,const char* name,int defaultValue);
 double ReadDouble(v8::Handle<v8::Object> obj,const char* name,double defaultValue=0.0);
+bool ReadBool(v8::Handle<v8::Object> obj,const char* name,bool defaultValue);
 
 void ReadPropertyPointFromArray(v8::Handle<v8::Array> value,double* x,double* y, double*z );
 // void ReadPropertyPoint( Handle<Object> value,const char* name,double* x,double* y, double*z );
@@ -92,6 +93,8 @@ inline v8::Local<v8::Value> makeArrayBuffer(int length) {
 #define GET_UINT32ARRAY_ARRAY_DATA(value)   GET_UINT32ARRAY_DATA(value)
 #define GET_UINT32ARRAY_ARRAY_LENGTH(value) (value.As<v8::Uint32Array>()->Length())
 
+#define GET_FLOAT64ARRAY_DATA(value)        (double*)(static_cast<char*>(value.As<v8::Float64Array>()->Buffer()->GetContents().Data()) + value.As<v8::Float64Array>()->ByteOffset())
+
 
 inline v8::Local<v8::Object> makeTypedArray(ArrayType type, unsigned int length) {
 
@@ -124,6 +127,32 @@ inline v8::Local<v8::Object> makeTypedArray(ArrayType type, unsigned int length)
   return array;
 }
 
+//
+// creates a typed array on top of an externalized ArrayBuffer that points
+// directly to native memory ( no copy is made ).
+// the memory is NOT owned by the ArrayBuffer : the caller must keep it alive
+// and unchanged as long as the buffer can be reached from javascript.
+//
+inline v8::Local<v8::Object> makeExternalTypedArray(ArrayType type, void* data, size_t length) {
+
+  size_t byteLength = length * ArrayTypeSize(type);
+  v8::Local<v8::ArrayBuffer> buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), data, byteLength);
+
+  switch (type) {
+  case A_Byte:    return v8::Uint8Array::New(buffer, 0, length);
+  case A_Int16:   return v8::Int16Array::New(buffer, 0, length);
+  case A_UInt16:  return v8::Uint16Array::New(buffer, 0, length);
+  case A_Int32:   return v8::Int32Array::New(buffer, 0, length);
+  case A_UInt32:  return v8::Uint32Array::New(buffer, 0, length);
+  case A_Float32: return v8::Float32Array::New(buffer, 0, length);
+  case A_Float64: return v8::Float64Array::New(buffer, 0, length);
+  default:
+    break;
+  }
+  Nan::ThrowError("Unsupported array type");
+  return v8::Local<v8::Object>();
+}
+
 
 inline v8::Local<v8::Object> makeFloat32Array(const float* data, int length) {
   v8::Local<v8::Object> array = makeTypedArray(A_Float32, length);
@@ -131,6 +160,12 @@ inline v8::Local<v8::Object> makeFloat32Array(const float* data, int length) {
   memcpy(dest, data, length * sizeof(data[0]));
   return array;
 }
+inline v8::Local<v8::Object> makeFloat64Array(const double* data, int length) {
+  v8::Local<v8::Object> array = makeTypedArray(A_Float64, length);
+  double* dest = GET_FLOAT64ARRAY_DATA(array);
+  memcpy(dest, data, length * sizeof(data[0]));
+  return array;
+}
 inline v8::Local<v8::Object> makeInt32Array(const int* data, int length) {
   v8::Local<v8::Object> array = makeTypedArray(A_Int32, length);
   int* dest = GET_INT32ARRAY_ARRAY_DATA(array);
@@ -0,0 +1,152 @@
+// checks the mesh options of Solid.createMesh on known solids :
+//  - parallel meshing gives the same buffers as serial meshing
+//  - weld only removes duplicated vertices
+//  - vertexCache keeps the triangles and lowers the ACMR
+//  - decimate removes triangles without leaving the surface by more than maxError
+//
+// usage : node test/mesh.js
+// ( OCC_MODULE selects the native module, build/Release/occ by default )
+"use strict";
+const assert = require("assert");
+const path = require("path");
+const occ = require(process.env.OCC_MODULE || path.join(__dirname, "..", "build", "Release", "occ"));
+
+const RADIUS = 10;
+
+// each test builds new solids : meshing the same solid twice would only
+// read back the triangulations ( or the face mesh cache ) of the first run
+function makePart() {
+  const box = occ.makeBox([-20, -20, 0], [20, 20, 10]);
+  const cylinder = occ.makeCylinder(6, 30);
+  const sphere = occ.makeSphere([0, 0, 30], RADIUS);
+  return occ.cut(occ.fuse(box, sphere), cylinder);
+}
+
+function makeSphere() {
+  return occ.makeSphere([0, 0, 0], RADIUS);
+}
+
+function bytes(array) {
+  return Buffer.from(array.buffer, array.byteOffset, array.byteLength);
+}
+
+function assertSameBuffer(a, b, name) {
+  assert.strictEqual(a.length, b.length, name + " : different lengths");
+  assert.ok(bytes(a).equals(bytes(b)), name + " : different contents");
+}
+
+// faceranges : hash code, first triangle, number of triangles, first vertex, number of vertices.
+// the hash codes belong to the faces of each solid, only the ranges can be compared
+function assertSameFaceRanges(a, b) {
+  assert.strictEqual(a.length, b.length, "faceranges : different lengths");
+  for (let i = 0; i < a.length; i++) {
+    if (i % 5 !== 0) {
+      assert.strictEqual(a[i], b[i], "faceranges : different range at " + i);
+    }
+  }
+}
+
+function assertValidIndices(mesh) {
+  const nbVertices = mesh.vertices.length / 3;
+  assert.strictEqual(mesh.numVertices, nbVertices);
+  assert.strictEqual(mesh.numTriangles, mesh.triangles.length / 3);
+  for (let i = 0; i < mesh.triangles.length; i++) {
+    assert.ok(mesh.triangles[i] >= 0 && mesh.triangles[i] < nbVertices, "triangle index out of range");
+  }
+  for (let i = 0; i < mesh.edgeindices.length; i++) {
+    assert.ok(mesh.edgeindices[i] < nbVertices, "edge index out of range");
+  }
+}
+
+// smallest distance to the center of the sphere over the vertices, the middle
+// of the sides and the centroid of each triangle
+function minimumRadius(mesh) {
+  const v = mesh.vertices;
+  const t = mesh.triangles;
+  let minimum = Infinity;
+  function measure(x, y, z) {
+    minimum = Math.min(minimum, Math.sqrt(x * x + y * y + z * z));
+  }
+  for (let i = 0; i < t.length; i += 3) {
+    const a = 3 * t[i], b = 3 * t[i + 1], c = 3 * t[i + 2];
+    measure(v[a], v[a + 1], v[a + 2]);
+    measure((v[a] + v[b]) / 2, (v[a + 1] + v[b + 1]) / 2, (v[a + 2] + v[b + 2]) / 2);
+    measure((v[b] + v[c]) / 2, (v[b + 1] + v[c + 1]) / 2, (v[b + 2] + v[c + 2]) / 2);
+    measure((v[c] + v[a]) / 2, (v[c + 1] + v[a + 1]) / 2, (v[c + 2] + v[a + 2]) / 2);
+    measure((v[a] + v[b] + v[c]) / 3, (v[a + 1] + v[b + 1] + v[c + 1]) / 3, (v[a + 2] + v[b + 2] + v[c + 2]) / 3);
+  }
+  return minimum;
+}
+
+const tests = {
+
+  "parallel meshing gives the same buffers as serial meshing": function () {
+    [makePart, makeSphere].forEach(function (make) {
+      [{}, { weld: true, vertexCache: true }].forEach(function (options) {
+        const serial = make().createMesh(0.01, 0.5, Object.assign({ parallel: false }, options));
+        const parallel = make().createMesh(0.01, 0.5, Object.assign({ parallel: true }, options));
+        assert.ok(serial.numTriangles > 0);
+        assertSameBuffer(serial.vertices, parallel.vertices, "vertices");
+        assertSameBuffer(serial.normals, parallel.normals, "normals");
+        assertSameBuffer(serial.triangles, parallel.triangles, "triangles");
+        assertSameBuffer(serial.edgeindices, parallel.edgeindices, "edgeindices");
+        assertSameFaceRanges(serial.faceranges, parallel.faceranges);
+      });
+    });
+  },
+
+  "weld only removes duplicated vertices": function () {
+    // the seam and the poles of the sphere duplicate vertices with the same normal
+    const raw = makeSphere().createMesh(0.01, 0.5);
+    const welded = makeSphere().createMesh(0.01, 0.5, { weld: true });
+    assertValidIndices(welded);
+    assert.strictEqual(raw.numWeldedVertices, 0);
+    assert.ok(welded.numWeldedVertices > 0, "the seam of the sphere should be welded");
+    assert.strictEqual(welded.numVertices + welded.numWeldedVertices, raw.numVertices);
+    // only the triangles that collapse at the poles can disappear
+    assert.ok(welded.numTriangles <= raw.numTriangles);
+    assert.ok(welded.numTriangles > 0.95 * raw.numTriangles);
+  },
+
+  "vertexCache keeps the triangles and lowers the ACMR": function () {
+    const raw = makePart().createMesh(0.01, 0.5, { weld: true });
+    const optimized = makePart().createMesh(0.01, 0.5, { weld: true, vertexCache: true });
+    assertValidIndices(optimized);
+    assert.strictEqual(optimized.numTriangles, raw.numTriangles);
+    assert.strictEqual(optimized.numVertices, raw.numVertices);
+    assert.ok(optimized.acmr < raw.acmr, "acmr " + optimized.acmr + " should be below " + raw.acmr);
+  },
+
+  "decimate stays within maxError of the surface": function () {
+    const deflection = 0.02;
+    const maxError = 0.1;
+    const options = { deflectionMode: "absolute" };
+    const raw = makeSphere().createMesh(deflection, 0.5, options);
+    const decimated = makeSphere().createMesh(deflection, 0.5,
+      Object.assign({ decimate: { ratio: 0.1, maxError: maxError } }, options));
+    assertValidIndices(decimated);
+    assert.ok(decimated.numDecimatedTriangles > 0, "no triangle has been decimated");
+    assert.strictEqual(decimated.numTriangles + decimated.numDecimatedTriangles, raw.numTriangles);
+
+    // the vertices stay on the sphere, the triangles are inside : the initial mesh
+    // is within the deflection ( with some margin ) and the decimation adds at most maxError
+    const initialBound = RADIUS - 2 * deflection;
+    assert.ok(minimumRadius(raw) >= initialBound, "the initial mesh is not within the deflection");
+    const radius = minimumRadius(decimated);
+    assert.ok(radius >= initialBound - maxError,
+      "the decimated mesh is " + (RADIUS - radius) + " away from the sphere");
+  }
+};
+
+let failures = 0;
+Object.keys(tests).forEach(function (name) {
+  try {
+    tests[name]();
+    console.log("ok     " + name);
+  } catch (err) {
+    failures++;
+    console.log("FAILED " + name);
+    console.log(err.stack);
+  }
+});
+process.exitCode = failures ? 1 : 0;